@@ -23,16 +23,21 @@ DEFINES += QCURL_LIBRARY
 # deprecated API in order to know how to port your code away from it.
 DEFINES += QT_DEPRECATED_WARNINGS
 
+# qmake CONFIG+=developer-build exports the private classes that
+# tests/auto use
+developer-build: DEFINES += QCURL_BUILD_INTERNAL
+
 
 # You can also make your code fail to compile if you use deprecated APIs.
 # In order to do so, uncomment the following line.
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-SOURCES += qcurl.cpp
+SOURCES += qcurl.cpp qcurlengine.cpp qcurlloopback.cpp qcurlepollsocket.cpp
 
-HEADERS += qringbuffer_p.h qhttpauthenticator_p.h \
-        qcurl.h \
+HEADERS += qringbuffer_p.h qhttpauthenticator_p.h qcurlratelimiter_p.h qcurlengine_p.h qcurlsocketoptions_p.h \
+        qcurlepollsocket_p.h qcurlrequest_p.h \
+        qcurl.h qcurlengine.h qcurlcoro.h qcurlloopback.h qcurlepollsocket.h \
         qcurl_global.h 
 
 unix {
@@ -55,13 +55,44 @@
 # include "qstringlist.h"
 # include "qbuffer.h"
 # include "qringbuffer_p.h"
+# include "qcurlratelimiter_p.h"
+# include "qcurlsocketoptions_p.h"
+# include "qcurlrequest_p.h"
 # include "qcoreevent.h"
+# include "qcoreapplication.h"
+# include "qmutex.h"
+# include "qset.h"
 # include "qurl.h"
 # include "qnetworkproxy.h"
 # include "qauthenticator.h"
 # include "qhttpauthenticator_p.h"
 # include "qdebug.h"
 # include "qtimer.h"
+# include "qthread.h"
+# include "qthreadstorage.h"
+# include "qpointer.h"
+# include "qfutureinterface.h"
+# include "qelapsedtimer.h"
+# include "qhash.h"
+# include "qdatetime.h"
+# include "qfile.h"
+# if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#  include "qrandom.h"
+# endif
+#endif
+
+#include <algorithm>
+#include <utility>
+
+#ifdef Q_OS_UNIX
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include <errno.h>
+# include <fcntl.h>
+# include <stddef.h>
+# include <string.h>
+# include <unistd.h>
 #endif
 
 
@@ -72,15 +103,92 @@
 
 QT_BEGIN_NAMESPACE
 
+static const int QCurlTimeoutCount = QCurl::ReadIdleTimeout + 1;
+// a cancelled response with at most this much body left is read to the
+// end so that its connection can be reused
+static const qint64 QCurlMaxDrainSize = 64 * 1024;
+static const int QCurlMaxReadBuffer = 1024 * 1024;
+
+Q_GLOBAL_STATIC(QCurlRateLimiter, globalRateLimiter)
+
+Q_GLOBAL_STATIC(QThreadStorage<QCurlRecordPool *>, recordPools)
+
+QCurlRecordPool::~QCurlRecordPool()
+{
+    for (int i = 0; i < Classes; ++i) {
+        while (Block *b = freeList[i]) {
+            freeList[i] = b->next;
+            ::operator delete(b);
+        }
+    }
+}
+
+QCurlRecordPool *QCurlRecordPool::local(bool create)
+{
+    if (recordPools.isDestroyed())
+        return 0;
+    QThreadStorage<QCurlRecordPool *> *pools = recordPools();
+    if (!pools->hasLocalData()) {
+        if (!create)
+            return 0;
+        pools->setLocalData(new QCurlRecordPool);
+    }
+    return pools->localData();
+}
+
+void *QCurlRecordPool::allocate(size_t size)
+{
+    const size_t c = size ? (size - 1) / Granularity : 0;
+    if (c >= size_t(Classes))
+        return ::operator new(size);
+
+    QCurlRecordPool *pool = local(true);
+    if (pool && pool->freeList[c]) {
+        Block *b = pool->freeList[c];
+        pool->freeList[c] = b->next;
+        --pool->freeCount[c];
+        return b;
+    }
+    // always the full size of the class, the block may be reused for
+    // any size of it
+    return ::operator new((c + 1) * Granularity);
+}
+
+void QCurlRecordPool::release(void *p, size_t size)
+{
+    if (!p)
+        return;
+    const size_t c = size ? (size - 1) / Granularity : 0;
+    QCurlRecordPool *pool = c < size_t(Classes) ? local(false) : 0;
+    if (!pool || pool->freeCount[c] >= MaxFree) {
+        ::operator delete(p);
+        return;
+    }
+    Block *b = static_cast<Block *>(p);
+    b->next = pool->freeList[c];
+    pool->freeList[c] = b;
+    ++pool->freeCount[c];
+}
+
 class QCurlNormalRequest;
 class QCurlRequest
 {
 public:
-    QCurlRequest() : finished(false)
-    { id = idCounter.fetchAndAddRelaxed(1); }
+    QCurlRequest() : finished(false), started(false), hasResponse(false), quiet(false), awaiter(0), sink(0), attempts(1), retryPolicy(0), retryPolicySet(false),
+        hedgeable(false), priority(QCurl::NormalPriority), finishTag(0)
+    {
+        id = idCounter.fetchAndAddRelaxed(1);
+        for (int i = 0; i < QCurlTimeoutCount; ++i)
+            timeouts[i] = -1;
+    }
     virtual ~QCurlRequest()
     { }
 
+    static void *operator new(size_t size)
+    { return QCurlRecordPool::allocate(size); }
+    static void operator delete(void *p, size_t size)
+    { QCurlRecordPool::release(p, size); }
+
     virtual void start(QCurl *) = 0;
     virtual bool hasRequestHeader();
     virtual QCurlRequestHeader requestHeader();
@@ -90,11 +198,316 @@ public:
 
     int id;
     bool finished;
+    bool started;
+    bool hasResponse;                   // responseHeaderReceived() was emitted for it
+    bool quiet;                         // part of a batch: no per request signals
+    QCurlAwaiter *awaiter;
+    QCurlSink *sink;
+    int timeouts[QCurlTimeoutCount];    // -1 means use the QCurl default
+    int attempts;
+    QCurlRetryPolicy *retryPolicy;      // used instead of QCurl's when retryPolicySet
+    bool retryPolicySet;
+    bool hedgeable;                     // a get() that may be duplicated when slow
+    QCurl::Priority priority;
+    QString flow;
+    qreal finishTag;                    // virtual finish time for fair queuing
 
 private:
     static QBasicAtomicInt idCounter;
 };
 
+// collects the reply for execute()
+class QCurlSyncAwaiter : public QCurlAwaiter
+{
+public:
+    QCurlSyncAwaiter() : done(false)
+    { }
+
+    void readyRead()
+    { }
+    void finished(const QCurlReply &r)
+    {
+        reply = r;
+        done = true;
+    }
+
+    QCurlReply reply;
+    bool done;
+};
+
+// a call of an awaiter, made once QCurl is done with the request
+struct QCurlAwaiterCall
+{
+    QCurlAwaiter *awaiter;
+    int id;
+    bool finished;          // finished() with reply, readyRead() otherwise
+    QCurlReply reply;
+};
+
+/*
+    Hands the awaiters of a destroyed QCurl their replies: aborted for
+    the requests that were still pending, the real one for those that
+    finished but were not reported yet. This happens from the event
+    loop once the object is gone; a coroutine resumed from the
+    destructor would still find it alive. An awaiter that is destroyed
+    before that is forgotten.
+*/
+class QCurlOrphanNotifier : public QObject
+{
+public:
+    void adopt(QCurlAwaiter *awaiter, const QCurlReply &reply);
+    static void forget(QCurlAwaiter *awaiter);
+
+protected:
+    void customEvent(QEvent *);
+
+private:
+    QList<QPair<QCurlAwaiter *, QCurlReply> > awaiters;
+    static QBasicAtomicInt count;
+};
+
+struct QCurlOrphans
+{
+    QMutex mutex;
+    QSet<QCurlAwaiter *> awaiters;
+};
+
+Q_GLOBAL_STATIC(QCurlOrphans, curlOrphans)
+
+QBasicAtomicInt QCurlOrphanNotifier::count = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+void QCurlOrphanNotifier::adopt(QCurlAwaiter *awaiter, const QCurlReply &reply)
+{
+    QCurlOrphans *orphans = curlOrphans();
+    QMutexLocker locker(&orphans->mutex);
+    orphans->awaiters.insert(awaiter);
+    count.ref();
+    awaiters.append(qMakePair(awaiter, reply));
+}
+
+void QCurlOrphanNotifier::forget(QCurlAwaiter *awaiter)
+{
+    // most awaiters never were orphaned
+    if (count.loadAcquire() == 0 || curlOrphans.isDestroyed())
+        return;
+    QCurlOrphans *orphans = curlOrphans();
+    QMutexLocker locker(&orphans->mutex);
+    if (orphans->awaiters.remove(awaiter))
+        count.deref();
+}
+
+void QCurlOrphanNotifier::customEvent(QEvent *)
+{
+    for (int i = 0; i < awaiters.count(); ++i) {
+        QCurlAwaiter *awaiter = awaiters.at(i).first;
+        {
+            // an earlier one may have destroyed it
+            QCurlOrphans *orphans = curlOrphans();
+            QMutexLocker locker(&orphans->mutex);
+            if (!orphans->awaiters.remove(awaiter))
+                continue;
+            count.deref();
+        }
+        awaiter->finished(awaiters.at(i).second);
+    }
+    deleteLater();
+}
+
+#ifdef Q_OS_UNIX
+/*
+    The transport for setLocalServer(): a QTcpSocket driving a connected
+    AF_UNIX stream socket, the way QLocalSocket does it on Unix. Connecting
+    ignores the host and port (they are only recorded as the peer, so that
+    the connection is reused like a TCP one). The connect is non-blocking:
+    it usually completes right away, as local connects do not have to wait
+    for the network, but when the server's backlog is full it is retried
+    from a timer, like QLocalSocket does.
+*/
+class QCurlLocalSocket : public QTcpSocket
+{
+public:
+    enum { RetryInterval = 10, ConnectTimeout = 5000 };
+
+    explicit QCurlLocalSocket(const QString &serverName)
+        : server(serverName), addressLength(0), connectingFd(-1), retryTimer(0), peerPortNumber(0)
+    { }
+    ~QCurlLocalSocket();
+
+    void connectToHost(const QString &hostName, quint16 port, OpenMode mode = ReadWrite,
+                       NetworkLayerProtocol protocol = AnyIPProtocol) Q_DECL_OVERRIDE;
+    bool waitForConnected(int msecs = 30000) Q_DECL_OVERRIDE;
+    void close() Q_DECL_OVERRIDE;
+
+protected:
+    void timerEvent(QTimerEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    void tryConnect();
+    void cancelConnect();
+    void fail(QAbstractSocket::SocketError socketError, const QString &message);
+
+    QString server;
+    struct sockaddr_un address;
+    socklen_t addressLength;
+    int connectingFd;       // the socket while the connect is pending
+    int retryTimer;
+    QElapsedTimer connectClock;
+    QString peerHost;
+    quint16 peerPortNumber;
+    OpenMode openMode;
+};
+
+QCurlLocalSocket::~QCurlLocalSocket()
+{
+    cancelConnect();
+}
+
+void QCurlLocalSocket::connectToHost(const QString &hostName, quint16 port, OpenMode mode,
+                                     NetworkLayerProtocol)
+{
+    if (state() != UnconnectedState)
+        abort();
+
+    // a leading '@' names a socket in the abstract namespace (Linux)
+    QByteArray name = QFile::encodeName(server);
+    bool abstract = false;
+#ifdef Q_OS_LINUX
+    if (name.startsWith('@')) {
+        name[0] = '\0';
+        abstract = true;
+    }
+#endif
+
+    ::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (name.isEmpty() || size_t(name.size()) >= sizeof(address.sun_path)) {
+        fail(HostNotFoundError, QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Invalid local server name")));
+        return;
+    }
+    ::memcpy(address.sun_path, name.constData(), name.size());
+    addressLength = offsetof(struct sockaddr_un, sun_path) + name.size() + (abstract ? 0 : 1);
+
+#ifdef SOCK_NONBLOCK
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+#else
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd != -1) {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+#endif
+    if (fd == -1) {
+        fail(UnknownSocketError, qt_error_string(errno));
+        return;
+    }
+
+    connectingFd = fd;
+    peerHost = hostName;
+    peerPortNumber = port;
+    openMode = mode;
+    connectClock.start();
+    setSocketState(ConnectingState);
+    emit hostFound();
+    tryConnect();
+}
+
+void QCurlLocalSocket::tryConnect()
+{
+    int result;
+    do {
+        result = ::connect(connectingFd, reinterpret_cast<struct sockaddr *>(&address), addressLength);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1 && errno != EISCONN) {
+        int err = errno;
+        if (err == EAGAIN || err == EINPROGRESS || err == EALREADY) {
+            // the server's backlog is full; try again shortly
+            if (connectClock.elapsed() < ConnectTimeout) {
+                if (!retryTimer)
+                    retryTimer = startTimer(RetryInterval);
+                return;
+            }
+            cancelConnect();
+            fail(SocketTimeoutError, QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Connection to local server timed out")));
+            return;
+        }
+        cancelConnect();
+        fail(err == ENOENT ? HostNotFoundError : ConnectionRefusedError, qt_error_string(err));
+        return;
+    }
+
+    int fd = connectingFd;
+    connectingFd = -1;
+    if (retryTimer) {
+        killTimer(retryTimer);
+        retryTimer = 0;
+    }
+    // from here on the socket is driven by QTcpSocket
+    if (!setSocketDescriptor(fd, ConnectedState, openMode)) {
+        ::close(fd);
+        fail(error(), errorString());
+        return;
+    }
+    setPeerName(peerHost);
+    setPeerPort(peerPortNumber);
+    emit connected();
+}
+
+void QCurlLocalSocket::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != retryTimer) {
+        QTcpSocket::timerEvent(event);
+        return;
+    }
+    // the attempt may have been given up on meanwhile
+    if (connectingFd == -1 || state() != ConnectingState) {
+        cancelConnect();
+        return;
+    }
+    tryConnect();
+}
+
+// execute() has no event loop to fire the retry timer
+bool QCurlLocalSocket::waitForConnected(int msecs)
+{
+    QElapsedTimer clock;
+    clock.start();
+    while (connectingFd != -1 && state() == ConnectingState) {
+        if (msecs >= 0 && clock.elapsed() >= msecs)
+            return false;
+        QThread::msleep(RetryInterval);
+        tryConnect();
+    }
+    return state() == ConnectedState;
+}
+
+void QCurlLocalSocket::close()
+{
+    cancelConnect();
+    QTcpSocket::close();
+}
+
+void QCurlLocalSocket::cancelConnect()
+{
+    if (retryTimer) {
+        killTimer(retryTimer);
+        retryTimer = 0;
+    }
+    if (connectingFd != -1) {
+        ::close(connectingFd);
+        connectingFd = -1;
+    }
+}
+
+void QCurlLocalSocket::fail(QAbstractSocket::SocketError socketError, const QString &message)
+{
+    setSocketState(UnconnectedState);
+    setSocketError(socketError);
+    setErrorString(message);
+    emit error(socketError);
+}
+#endif
+
 class QCurlPrivate : public QObjectPrivate
 {
   Q_OBJECT
@@ -106,19 +519,25 @@ public:
         : socket(0), reconnectAttempts(2),
           deleteSocket(0), state(QCurl::Unconnected),
           error(QCurl::NoError), port(0), mode(QCurl::ConnectionModeHttp),
-          toDevice(0), postDevice(0), bytesDone(0), chunkedSize(-1),
-          repost(false), pendingPost(false), q_ptr(parent)
+          toDevice(0), postDevice(0), bytesDone(0), chunkedSize(-1), encodedHostPort(0),
+          repost(false), pendingPost(false),
+          keepAliveTimeout(-1), keepAliveMax(-1), idleTimeout(0), idleLimit(-1),
+          phase(QCurl::TransferTimeout), queueHadError(false),
+          errorPolicy(QCurl::AbortPendingOnError), retryPolicy(0), retrying(false),
+          retryDelayMsecs(0), draining(false), hedgingEnabled(false), hedgingPercentile(95), hedgePort(0),
+          latencyIndex(0), hedgeCurl(0), hedgeId(0), hedgeRequestId(0), hedgeHolding(false), virtualTime(0),
+          maxBufferSize(0), readPaused(false), watchedDevice(0), notifyBytes(0), notifyMsecs(0),
+          readNotified(-1), sendNotified(-1), readDone(0), readTotal(0), sendDone(0), sendTotal(0),
+          readHeld(false), readyReadHeld(false), sendHeld(false), synchronous(false),
+          socketOptionsPending(false), q_ptr(parent)
     {
+        for (int i = 0; i < QCurlTimeoutCount; ++i)
+            timeouts[i] = 0;
+        for (int i = 0; i < QCurlSocketOptionCount; ++i)
+            socketOptions[i] = -1;
     }
 
-    inline ~QCurlPrivate()
-    {
-        while (!pending.isEmpty())
-            delete pending.takeFirst();
-
-        if (deleteSocket)
-            delete socket;
-    }
+    ~QCurlPrivate();
 
     // private slots
     void _q_startNextRequest();
@@ -131,19 +550,93 @@ public:
     void _q_slotDoFinished();
     void _q_slotSendRequest();
     void _q_continuePost();
+    void _q_slotIdleTimeout();
+    void _q_slotHostFound();
+    void _q_slotEncrypted();
+    void _q_slotTransferTimeout();
+    void _q_slotPhaseTimeout();
+    void _q_slotRetry();
+    void _q_slotHedge();
+    void _q_slotHedgeFinished(int id, bool error);
+    void _q_slotPaceRead();
+    void _q_slotPaceWrite();
+    void _q_slotDeviceBytesWritten();
+    void _q_slotFlushNotifications();
 
     int addRequest(QCurlNormalRequest *);
     int addRequest(QCurlRequest *);
+    void addRequests(const QVector<QCurlRequest *> &reqs);
+    int indexOf(int id) const;
+    void assignFinishTag(QCurlRequest *r);
+    void reposition(int index);
     void finishedWithSuccess();
     void finishedWithError(const QString &detail, int errorCode);
+    void finishedAllWithError(const QString &detail, int errorCode);
+    void finishedRequestWithError(const QString &detail, int errorCode, bool keepConnection = false);
+    void resetConnection();
+    bool cancelCurrent();
+    void discardRequest(QCurlRequest *r);
+    void detachAwaiters();
+    void notifyFinished(QCurlRequest *r, bool failed);
+    void callAwaiterLater(QCurlAwaiter *awaiter, int id, bool finished,
+                          const QCurlReply &reply = QCurlReply());
+    void _q_callAwaiters();
 
     void init();
     void setState(int);
     void closeConn();
     void setSock(QTcpSocket *sock);
+    void publishSocketOptions();
 
     void postMoreData();
 
+    void parseKeepAlive();
+    void startIdleTimer();
+    bool isConnectionStale();
+
+    int timeoutValue(QCurl::Timeout type) const;
+    void startPhase(QCurl::Timeout type);
+    void stopTimeouts();
+
+    QCurlRetryPolicy *currentRetryPolicy() const;
+    bool canRetry() const;
+    bool retryRequest(QCurl::Error err);
+    bool retryResponse();
+    void scheduleRetry(int msecs);
+
+    void recordLatency(int msecs);
+    int hedgeDelay() const;
+    void cancelHedge();
+    void publishResponse();
+    bool deliverBody(const QByteArray &body);
+
+    qint64 transferAllowance(QCurlRateLimiter::Direction dir, qint64 wanted);
+    int transferDelay(QCurlRateLimiter::Direction dir, qint64 wanted);
+    void takeTransfer(QCurlRateLimiter::Direction dir, qint64 count);
+    int requestDelay();
+    void applyReadBufferSize();
+
+    qint64 bufferedBytes() const;
+    void pauseReading();
+    void resumeReading();
+    void unwatchDevice();
+
+    bool notificationDue(qint64 done, qint64 notified) const;
+    void notifyReadProgress(qint64 done, qint64 total, bool dataReady);
+    void notifySendProgress(qint64 done, qint64 total);
+    void dropNotifications();
+
+    QString hostField() const;
+    const QByteArray &encodedHostField();
+    void expandHeader();
+
+    void invokeLater(const char *member);
+    void armTimer(QTimer &timer, int msecs);
+    void disarmTimer(QTimer &timer);
+    bool timerArmed(const QTimer &timer) const;
+    void runSynchronously(const QCurlSyncAwaiter *awaiter, int msecs);
+    bool waitForSocket(int msecs);
+
     QTcpSocket *socket;
     int reconnectAttempts;
     bool deleteSocket;
@@ -156,8 +649,10 @@ public:
     QString hostName;
     quint16 port;
     QCurl::ConnectionMode mode;
+    QString localServer;    // connect to this local socket instead of hostName
 
     QByteArray buffer;
+    QByteArray readBuffer;  // what _q_slotReadyRead() took from the socket
     QIODevice *toDevice;
     QIODevice *postDevice;
 
@@ -166,6 +661,10 @@ public:
     qint64 chunkedSize;
 
     QCurlRequestHeader header;
+    QByteArray serializedHeader;    // sent instead of header when not empty; keeps its capacity
+    QByteArray encodedHost;         // hostField() in Latin-1, for encodedHostName:encodedHostPort
+    QString encodedHostName;
+    quint16 encodedHostPort;
 
     bool readHeader;
     QString headerStr;
@@ -182,6 +681,104 @@ public:
     bool hasFinishedWithError;
     bool pendingPost;
     QTimer post100ContinueTimer;
+
+    // keep-alive bookkeeping; timeout and max come from the server's
+    // "Keep-Alive: timeout=, max=" hint and are -1 when it sent none
+    int keepAliveTimeout;
+    int keepAliveMax;
+    int idleTimeout;
+    int idleLimit;
+    QTimer idleTimer;
+    QElapsedTimer idleClock;
+
+    // request deadlines; the phase timer is re-armed on every transition
+    // (lookup, connect, handshake, first byte, inter-byte idle)
+    int timeouts[QCurlTimeoutCount];
+    QTimer transferTimer;
+    QTimer phaseTimer;
+    QCurl::Timeout phase;
+    bool queueHadError;
+    QCurl::ErrorPolicy errorPolicy;
+
+    QCurlRetryPolicy *retryPolicy;
+    QTimer retryTimer;
+    bool retrying;          // the response being read is dropped and retried
+    int retryDelayMsecs;
+    bool draining;          // the current request was cancelled, its body is discarded
+
+    // hedging: a get() still waiting for its response header after the
+    // configured percentile of recent header latencies is duplicated on
+    // a second connection, and the first complete response wins; the
+    // response of the original is held back while the duplicate runs
+    bool hedgingEnabled;
+    int hedgingPercentile;
+    QString hedgeHost;
+    quint16 hedgePort;
+    QList<int> latencySamples;
+    int latencyIndex;
+    QElapsedTimer requestClock;
+    QTimer hedgeTimer;
+    QCurl *hedgeCurl;
+    int hedgeId;
+    int hedgeRequestId;
+    bool hedgeHolding;
+    QByteArray hedgeHeld;
+
+    // scheduling: pending is kept ordered by priority and, within a
+    // priority, by the finish tags of weighted fair queuing over flows
+    QHash<QString, int> flowWeights;
+    QHash<QString, qreal> flowFinish;
+    qreal virtualTime;
+
+    // bandwidth and request rate limits of this object; the global ones
+    // apply on top of them
+    QCurlRateLimiter rateLimiter;
+    QTimer readPaceTimer;
+    QTimer writePaceTimer;
+    QTimer requestPaceTimer;
+    QBuffer uploadBuffer;   // lets an in-memory body be paced like a device
+
+    // flow control towards the consumer: at most maxBufferSize bytes of
+    // the response wait in rba or in toDevice's write buffer
+    qint64 maxBufferSize;
+    bool readPaused;
+    QPointer<QIODevice> watchedDevice;
+
+    // set with setSocketOption(), -1 for the system default; applied to
+    // each new connection once it is established
+    int socketOptions[QCurlSocketOptionCount];
+    bool socketOptionsPending;
+
+    // notification coalescing: progress and readyRead() go out once
+    // notifyBytes more bytes were transferred or notifyMsecs passed;
+    // what is held back is flushed by notifyTimer and at the end
+    qint64 notifyBytes;
+    int notifyMsecs;
+    QTimer notifyTimer;
+    QElapsedTimer notifyClock;
+    qint64 readNotified;    // progress last reported, -1 for none yet
+    qint64 sendNotified;
+    qint64 readDone;        // progress held back
+    qint64 readTotal;
+    qint64 sendDone;
+    qint64 sendTotal;
+    bool readHeld;
+    bool readyReadHeld;
+    bool sendHeld;
+
+    // execute(): there is no event loop to rely on, so queued calls and
+    // timers are kept here and driven by the blocking loop
+    bool synchronous;
+    QList<const char *> deferred;
+    QHash<QTimer *, qint64> syncTimers;
+    QElapsedTimer syncClock;
+
+#ifndef QT_NO_QFUTURE
+    QHash<int, QFutureInterface<QCurlReply> > futures;
+#endif
+    // the awaiter calls not made yet, in order
+    QList<QCurlAwaiterCall> awaiterCalls;
+
     QCurl *q_ptr;
 };
 
@@ -207,24 +804,23 @@ class QCurlNormalRequest : public QCurlRequest
 {
 public:
     QCurlNormalRequest(const QCurlRequestHeader &h, QIODevice *d, QIODevice *t) :
-        header(h), to(t)
-    {
-        is_ba = false;
-        data.dev = d;
-    }
+        header(h), dev(d), is_ba(false), to(t)
+    { }
 
-    QCurlNormalRequest(const QCurlRequestHeader &h, QByteArray *d, QIODevice *t) :
-        header(h), to(t)
-    {
-        is_ba = true;
-        data.ba = d;
-    }
+    // the body is shared with the caller and with QCurlPrivate::buffer,
+    // never copied
+    QCurlNormalRequest(const QCurlRequestHeader &h, const QByteArray &d, QIODevice *t) :
+        header(h), ba(d), dev(0), is_ba(true), to(t)
+    { }
+
+#ifdef Q_COMPILER_RVALUE_REFS
+    QCurlNormalRequest(const QCurlRequestHeader &h, QByteArray &&d, QIODevice *t) :
+        header(h), ba(std::move(d)), dev(0), is_ba(true), to(t)
+    { }
+#endif
 
     ~QCurlNormalRequest()
-    {
-        if (is_ba)
-            delete data.ba;
-    }
+    { }
 
     void start(QCurl *);
     bool hasRequestHeader();
@@ -236,12 +832,8 @@ public:
 
 protected:
     QCurlRequestHeader header;
-
-private:
-    union {
-        QByteArray *ba;
-        QIODevice *dev;
-    } data;
+    QByteArray ba;
+    QIODevice *dev;
     bool is_ba;
     QIODevice *to;
 };
@@ -251,9 +843,10 @@ void QCurlNormalRequest::start(QCurl *http)
     if (!http->d->socket)
         http->d->setSock(0);
     http->d->header = header;
+    http->d->serializedHeader.resize(0);
 
     if (is_ba) {
-        http->d->buffer = *data.ba;
+        http->d->buffer = ba;
         if (http->d->buffer.size() >= 0)
             http->d->header.setContentLength(http->d->buffer.size());
 
@@ -261,8 +854,8 @@ void QCurlNormalRequest::start(QCurl *http)
     } else {
         http->d->buffer = QByteArray();
 
-        if (data.dev && (data.dev->isOpen() || data.dev->open(QIODevice::ReadOnly))) {
-            http->d->postDevice = data.dev;
+        if (dev && (dev->isOpen() || dev->open(QIODevice::ReadOnly))) {
+            http->d->postDevice = dev;
             if (http->d->postDevice->size() >= 0)
                 http->d->header.setContentLength(http->d->postDevice->size());
         } else {
@@ -293,7 +886,7 @@ QIODevice *QCurlNormalRequest::sourceDevice()
 {
     if (is_ba)
         return 0;
-    return data.dev;
+    return dev;
 }
 
 QIODevice *QCurlNormalRequest::destinationDevice()
@@ -318,10 +911,16 @@ public:
         QCurlNormalRequest(h, d, t)
     { }
 
-    QCurlPGHRequest(const QCurlRequestHeader &h, QByteArray *d, QIODevice *t) :
+    QCurlPGHRequest(const QCurlRequestHeader &h, const QByteArray &d, QIODevice *t) :
         QCurlNormalRequest(h, d, t)
     { }
 
+#ifdef Q_COMPILER_RVALUE_REFS
+    QCurlPGHRequest(const QCurlRequestHeader &h, QByteArray &&d, QIODevice *t) :
+        QCurlNormalRequest(h, std::move(d), t)
+    { }
+#endif
+
     ~QCurlPGHRequest()
     { }
 
@@ -330,123 +929,431 @@ public:
 
 void QCurlPGHRequest::start(QCurl *http)
 {
-    if (http->d->port && http->d->port != 80)
-        header.setValue(QLatin1String("Host"), http->d->hostName + QLatin1Char(':') + QString::number(http->d->port));
-    else
-        header.setValue(QLatin1String("Host"), http->d->hostName);
+    header.setValue(QLatin1String("Host"), http->d->hostField());
     QCurlNormalRequest::start(http);
 }
 
 /****************************************************
  *
- * QCurlSetHostRequest
+ * QCurlTemplateRequest
+ * (a request made from a QCurlRequestTemplate: the
+ * header is not built, but written from the template's
+ * pre-serialized block plus the per request parts)
  *
  ****************************************************/
 
-class QCurlSetHostRequest : public QCurlRequest
+// Host and content-length are written by serialize() for every
+// request; a copy from the template or the caller would be sent twice
+static bool qt_curl_isGeneratedField(const QByteArray &key)
 {
-public:
-    QCurlSetHostRequest(const QString &h, quint16 p, QCurl::ConnectionMode m)
-        : hostName(h), port(p), mode(m)
-    { }
-
-    void start(QCurl *);
+    return qstricmp(key.constData(), "host") == 0
+        || qstricmp(key.constData(), "content-length") == 0;
+}
 
-    QIODevice *sourceDevice()
-    { return 0; }
-    QIODevice *destinationDevice()
-    { return 0; }
+void QCurlRequestTemplatePrivate::serializeFields()
+{
+    methodPart = prototype.method().toLatin1() + ' ';
+    fields.clear();
+    QList<QPair<QString, QString> > values = prototype.values();
+    for (int i = 0; i < values.count(); ++i) {
+        fields += values.at(i).first.toLatin1();
+        fields += ": ";
+        fields += values.at(i).second.toLatin1();
+        fields += "\r\n";
+    }
+}
 
-private:
-    QString hostName;
-    quint16 port;
-    QCurl::ConnectionMode mode;
-};
+// copies the bytes; appending a QByteArray to an empty one would share
+// it and drop the capacity of out
+static inline void qt_curl_append(QByteArray &out, const QByteArray &ba)
+{
+    out.append(ba.constData(), ba.size());
+}
 
-void QCurlSetHostRequest::start(QCurl *http)
+void QCurlRequestTemplatePrivate::serialize(const QString &path, const QByteArray &host,
+                                            const QList<QPair<QByteArray, QByteArray> > &values,
+                                            const QByteArray &body, QByteArray &out) const
 {
-    http->d->hostName = hostName;
-    http->d->port = port;
-    http->d->mode = mode;
+    int size = methodPart.size() + qMax(path.size(), 1) + host.size() + fields.size() + 32;
+    for (int i = 0; i < values.count(); ++i)
+        size += values.at(i).first.size() + values.at(i).second.size() + 4;
+    if (!body.isNull())
+        size += 32;
 
-#ifdef QT_NO_OPENSSL
-    if (mode == QCurl::ConnectionModeHttps) {
-        // SSL requested but no SSL support compiled in
-        http->d->finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "HTTPS connection requested but SSL support not compiled in")),
-                          QCurl::UnknownError);
-        return;
-    }
-#endif
+    // a reserved capacity survives resize(0)
+    out.resize(0);
+    if (out.capacity() < size)
+        out.reserve(size);
 
-    http->d->finishedWithSuccess();
+    qt_curl_append(out, methodPart);
+    if (path.isEmpty()) {
+        out.append('/');
+    } else {
+        // toLatin1() would allocate a temporary for every request
+        const int at = out.size();
+        out.resize(at + path.size());
+        char *dst = out.data() + at;
+        const QChar *src = path.constData();
+        for (int i = 0; i < path.size(); ++i)
+            dst[i] = src[i].unicode() > 0xff ? '?' : char(src[i].unicode());
+    }
+    out.append(" HTTP/1.1\r\nHost: ");
+    qt_curl_append(out, host);
+    out.append("\r\n");
+    qt_curl_append(out, fields);
+    for (int i = 0; i < values.count(); ++i) {
+        qt_curl_append(out, values.at(i).first);
+        out.append(": ");
+        qt_curl_append(out, values.at(i).second);
+        out.append("\r\n");
+    }
+    if (!body.isNull()) {
+        char digits[16];
+        char *end = digits + sizeof(digits);
+        char *p = end;
+        uint n = uint(body.size());
+        do {
+            *--p = char('0' + n % 10);
+            n /= 10;
+        } while (n);
+        out.append("content-length: ");
+        out.append(p, int(end - p));
+        out.append("\r\n");
+    }
+    out.append("\r\n");
 }
 
-/****************************************************
- *
- * QCurlSetUserRequest
- *
- ****************************************************/
-
-class QCurlSetUserRequest : public QCurlRequest
+class QCurlTemplateRequest : public QCurlNormalRequest
 {
 public:
-    QCurlSetUserRequest(const QString &userName, const QString &password) :
-        user(userName), pass(password)
-    { }
+    QCurlTemplateRequest(const QCurlRequestTemplate &t, const QString &p,
+                         const QList<QPair<QByteArray, QByteArray> > &v, const QByteArray &d, QIODevice *to) :
+        QCurlNormalRequest(t.d->prototype, d, to), tmpl(t), path(p), values(v)
+    {
+        // the list stays shared with the caller's unless a field has to go
+        for (int i = values.count() - 1; i >= 0; --i) {
+            if (qt_curl_isGeneratedField(values.at(i).first)) {
+                qWarning("QCurl::request: ignoring the %s field, it is set by QCurl", values.at(i).first.constData());
+                values.removeAt(i);
+            }
+        }
+    }
 
     void start(QCurl *);
-
-    QIODevice *sourceDevice()
-    { return 0; }
-    QIODevice *destinationDevice()
-    { return 0; }
+    QCurlRequestHeader requestHeader();
 
 private:
-    QString user;
-    QString pass;
+    QCurlRequestTemplate tmpl;
+    QString path;
+    QList<QPair<QByteArray, QByteArray> > values;
 };
 
-void QCurlSetUserRequest::start(QCurl *http)
+void QCurlTemplateRequest::start(QCurl *http)
 {
-    http->d->authenticator.setUser(user);
-    http->d->authenticator.setPassword(pass);
-    http->d->finishedWithSuccess();
+    QCurlPrivate *d = http->d.data();
+    if (!d->socket)
+        d->setSock(0);
+    // what the rest of QCurlPrivate looks at: method and fixed fields
+    d->header = header;
+    // constData(): the template is shared with the caller's copy, detaching
+    // it would copy the whole template for every request
+    tmpl.d.constData()->serialize(path, d->encodedHostField(), values, ba, d->serializedHeader);
+    d->buffer = ba;
+    d->postDevice = 0;
+
+    if (to && (to->isOpen() || to->open(QIODevice::WriteOnly)))
+        d->toDevice = to;
+    else
+        d->toDevice = 0;
+
+    d->reconnectAttempts = 2;
+    d->_q_slotSendRequest();
 }
 
-#ifndef QT_NO_NETWORKPROXY
+// the full header; only built when somebody asks for it
+QCurlRequestHeader QCurlTemplateRequest::requestHeader()
+{
+    QCurlRequestHeader h = header;
+    h.setRequest(h.method(), path.isEmpty() ? QString::fromLatin1("/") : path);
+    for (int i = 0; i < values.count(); ++i)
+        h.setValue(QString::fromLatin1(values.at(i).first), QString::fromLatin1(values.at(i).second));
+    return h;
+}
 
 /****************************************************
  *
- * QCurlSetProxyRequest
+ * QCurlBatchRequest
+ * (one request of submitBatch(); all requests of a
+ * batch live in a single block owned by the batch,
+ * which reports them together)
  *
  ****************************************************/
 
-class QCurlSetProxyRequest : public QCurlRequest
+class QCurlBatch;
+
+class QCurlBatchRequest : public QCurlPGHRequest
 {
 public:
-    inline QCurlSetProxyRequest(const QNetworkProxy &proxy)
+    QCurlBatchRequest(const QCurlRequestHeader &h, QIODevice *d, QCurlAwaiter *a) :
+        QCurlPGHRequest(h, d, 0)
     {
-        this->proxy = proxy;
+        quiet = true;
+        awaiter = a;
     }
 
-    inline void start(QCurl *http)
+    QCurlBatchRequest(const QCurlRequestHeader &h, const QByteArray &d, QCurlAwaiter *a) :
+        QCurlPGHRequest(h, d, 0)
     {
-        http->d->proxy = proxy;
-        QString user = proxy.user();
-        if (!user.isEmpty())
-            http->d->proxyAuthenticator.setUser(user);
-        QString password = proxy.password();
-        if (!password.isEmpty())
-            http->d->proxyAuthenticator.setPassword(password);
-        http->d->finishedWithSuccess();
+        quiet = true;
+        awaiter = a;
     }
 
-    inline QIODevice *sourceDevice()
-    { return 0; }
-    inline QIODevice *destinationDevice()
-    { return 0; }
-private:
-    QNetworkProxy proxy;
+    // constructed in place in the batch's block, which is freed by the
+    // batch once every request of it was deleted and reported
+    static void *operator new(size_t, void *where)
+    { return where; }
+    static void operator delete(void *, void *)
+    { }
+    static void operator delete(void *p);
+};
+
+// reports one request to its batch; kept apart from the request, which
+// may be deleted before its awaiter is called
+class QCurlBatchAwaiter : public QCurlAwaiter
+{
+public:
+    QCurlBatchAwaiter() : batch(0), index(0)
+    { }
+
+    void readyRead()
+    { }
+    void finished(const QCurlReply &reply);
+
+    QCurlBatch *batch;
+    int index;
+};
+
+class QCurlBatch
+{
+public:
+    struct Slot {
+        QCurlBatch *batch;
+        alignas(QCurlBatchRequest) char storage[sizeof(QCurlBatchRequest)];
+    };
+
+    QCurlBatch(QCurl *c, int n) :
+        curl(c), count(n), live(0), done(0), failed(0), hasContext(false)
+    {
+        id = idCounter.fetchAndAddRelaxed(1);
+        slots = new Slot[n];
+        awaiters = new QCurlBatchAwaiter[n];
+    }
+
+    ~QCurlBatch()
+    {
+        delete [] awaiters;
+        delete [] slots;
+    }
+
+    QCurlBatchRequest *create(int index, const QCurlRequestDescriptor &desc);
+    void itemFinished(int index, const QCurlReply &reply);
+    void release();
+
+    int id;
+    QCurl *curl;    // 0 once the QCurl object is being destroyed
+    int count;
+    int live;       // requests not yet deleted
+    int done;       // requests reported
+    int failed;
+    bool hasContext;
+    QPointer<const QObject> context;
+    std::function<void(int, const QCurlReply &)> callback;
+
+private:
+    Slot *slots;
+    QCurlBatchAwaiter *awaiters;
+    static QBasicAtomicInt idCounter;
+};
+
+QBasicAtomicInt QCurlBatch::idCounter = Q_BASIC_ATOMIC_INITIALIZER(1);
+
+QCurlBatchRequest *QCurlBatch::create(int index, const QCurlRequestDescriptor &desc)
+{
+    QCurlRequestHeader header(desc.method.isEmpty() ? QString::fromLatin1("GET") : desc.method, desc.path);
+    header.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
+
+    QCurlBatchAwaiter *awaiter = awaiters + index;
+    awaiter->batch = this;
+    awaiter->index = index;
+    Slot *slot = slots + index;
+    slot->batch = this;
+    ++live;
+    if (desc.data.isNull())
+        return new (slot->storage) QCurlBatchRequest(header, (QIODevice *) 0, awaiter);
+    return new (slot->storage) QCurlBatchRequest(header, desc.data, awaiter);
+}
+
+void QCurlBatch::itemFinished(int index, const QCurlReply &reply)
+{
+    if (reply.error() != QCurl::NoError)
+        ++failed;
+    // a request is reported either before or after it is deleted
+    bool last = ++done == count;
+    if (curl) {
+        if (callback && (!hasContext || context))
+            callback(index, reply);
+        if (last)
+            emit curl->batchFinished(id, failed);
+    }
+    if (last && live == 0)
+        delete this;
+}
+
+void QCurlBatch::release()
+{
+    if (--live == 0 && done == count)
+        delete this;
+}
+
+void QCurlBatchAwaiter::finished(const QCurlReply &reply)
+{
+    batch->itemFinished(index, reply);
+}
+
+void QCurlBatchRequest::operator delete(void *p)
+{
+    QCurlBatch::Slot *slot = reinterpret_cast<QCurlBatch::Slot *>(
+        static_cast<char *>(p) - offsetof(QCurlBatch::Slot, storage));
+    slot->batch->release();
+}
+
+/****************************************************
+ *
+ * QCurlSetHostRequest
+ *
+ ****************************************************/
+
+class QCurlSetHostRequest : public QCurlRequest
+{
+public:
+    QCurlSetHostRequest(const QString &h, quint16 p, QCurl::ConnectionMode m,
+                        const QString &server = QString())
+        : hostName(h), port(p), mode(m), localServer(server)
+    { }
+
+    void start(QCurl *);
+
+    QIODevice *sourceDevice()
+    { return 0; }
+    QIODevice *destinationDevice()
+    { return 0; }
+
+private:
+    QString hostName;
+    quint16 port;
+    QCurl::ConnectionMode mode;
+    QString localServer;
+};
+
+void QCurlSetHostRequest::start(QCurl *http)
+{
+    http->d->hostName = hostName;
+    http->d->port = port;
+    http->d->mode = mode;
+
+    if (localServer != http->d->localServer) {
+#ifndef Q_OS_UNIX
+        if (!localServer.isEmpty()) {
+            http->d->finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Local servers are not supported on this platform")),
+                              QCurl::UnknownError);
+            return;
+        }
+#endif
+        http->d->localServer = localServer;
+        // a socket of our own is replaced by one of the new transport;
+        // one set with setSocket() stays
+        if (http->d->deleteSocket)
+            http->d->setSock(0);
+    }
+
+#ifdef QT_NO_OPENSSL
+    if (mode == QCurl::ConnectionModeHttps) {
+        // SSL requested but no SSL support compiled in
+        http->d->finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "HTTPS connection requested but SSL support not compiled in")),
+                          QCurl::UnknownError);
+        return;
+    }
+#endif
+
+    http->d->finishedWithSuccess();
+}
+
+/****************************************************
+ *
+ * QCurlSetUserRequest
+ *
+ ****************************************************/
+
+class QCurlSetUserRequest : public QCurlRequest
+{
+public:
+    QCurlSetUserRequest(const QString &userName, const QString &password) :
+        user(userName), pass(password)
+    { }
+
+    void start(QCurl *);
+
+    QIODevice *sourceDevice()
+    { return 0; }
+    QIODevice *destinationDevice()
+    { return 0; }
+
+private:
+    QString user;
+    QString pass;
+};
+
+void QCurlSetUserRequest::start(QCurl *http)
+{
+    http->d->authenticator.setUser(user);
+    http->d->authenticator.setPassword(pass);
+    http->d->finishedWithSuccess();
+}
+
+#ifndef QT_NO_NETWORKPROXY
+
+/****************************************************
+ *
+ * QCurlSetProxyRequest
+ *
+ ****************************************************/
+
+class QCurlSetProxyRequest : public QCurlRequest
+{
+public:
+    inline QCurlSetProxyRequest(const QNetworkProxy &proxy)
+    {
+        this->proxy = proxy;
+    }
+
+    inline void start(QCurl *http)
+    {
+        http->d->proxy = proxy;
+        QString user = proxy.user();
+        if (!user.isEmpty())
+            http->d->proxyAuthenticator.setUser(user);
+        QString password = proxy.password();
+        if (!password.isEmpty())
+            http->d->proxyAuthenticator.setPassword(password);
+        http->d->finishedWithSuccess();
+    }
+
+    inline QIODevice *sourceDevice()
+    { return 0; }
+    inline QIODevice *destinationDevice()
+    { return 0; }
+private:
+    QNetworkProxy proxy;
 };
 
 #endif // QT_NO_NETWORKPROXY
@@ -504,17 +1411,31 @@ void QCurlCloseRequest::start(QCurl *http)
     http->d->closeConn();
 }
 
-class QCurlHeaderPrivate
+class QCurlHeaderPrivate : public QSharedData
 {
-    Q_DECLARE_PUBLIC(QCurlHeader)
 public:
     inline virtual ~QCurlHeaderPrivate() {}
+    virtual QCurlHeaderPrivate *clone() const
+    { return new QCurlHeaderPrivate(*this); }
+    // an empty, invalid private of the same type, for a moved-from header
+    virtual QCurlHeaderPrivate *create() const
+    { return new QCurlHeaderPrivate(); }
+
+    static void *operator new(size_t size)
+    { return QCurlRecordPool::allocate(size); }
+    static void operator delete(void *p, size_t size)
+    { QCurlRecordPool::release(p, size); }
 
     QList<QPair<QString, QString> > values;
     bool valid;
-    QCurlHeader *q_ptr;
 };
 
+// detaching has to copy the request or response part as well
+template <> QCurlHeaderPrivate *QSharedDataPointer<QCurlHeaderPrivate>::clone()
+{
+    return d->clone();
+}
+
 /****************************************************
  *
  * QCurlHeader
@@ -553,6 +1474,9 @@ public:
     set the value for a key which already exists the previous value
     will be discarded.
 
+    The header classes are implicitly shared: copying a header is cheap,
+    and the fields are only copied when one of the copies is modified.
+
     \sa QCurlRequestHeader QCurlResponseHeader
 */
 
@@ -575,7 +1499,6 @@ QCurlHeader::QCurlHeader()
     : d_ptr(new QCurlHeaderPrivate)
 {
     Q_D(QCurlHeader);
-    d->q_ptr = this;
     d->valid = true;
 }
 
@@ -583,14 +1506,22 @@ QCurlHeader::QCurlHeader()
         Constructs a copy of \a header.
 */
 QCurlHeader::QCurlHeader(const QCurlHeader &header)
-    : d_ptr(new QCurlHeaderPrivate)
+    : d_ptr(header.d_ptr)
 {
-    Q_D(QCurlHeader);
-    d->q_ptr = this;
-    d->valid = header.d_func()->valid;
-    d->values = header.d_func()->values;
 }
 
+#ifdef Q_COMPILER_RVALUE_REFS
+/*! \internal
+    Takes over the fields of \a header, which is left an empty, invalid
+    header of its own type.
+*/
+QCurlHeader::QCurlHeader(QCurlHeader &&header)
+    : d_ptr(header.d_ptr.constData()->create())
+{
+    d_ptr.swap(header.d_ptr);
+}
+#endif
+
 /*!
     Constructs a HTTP header for \a str.
 
@@ -603,7 +1534,6 @@ QCurlHeader::QCurlHeader(const QString &str)
     : d_ptr(new QCurlHeaderPrivate)
 {
     Q_D(QCurlHeader);
-    d->q_ptr = this;
     d->valid = true;
     parse(str);
 }
@@ -614,7 +1544,6 @@ QCurlHeader::QCurlHeader(QCurlHeaderPrivate &dd, const QString &str)
     : d_ptr(&dd)
 {
     Q_D(QCurlHeader);
-    d->q_ptr = this;
     d->valid = true;
     if (!str.isEmpty())
         parse(str);
@@ -626,7 +1555,6 @@ QCurlHeader::QCurlHeader(QCurlHeaderPrivate &dd, const QCurlHeader &header)
     : d_ptr(&dd)
 {
     Q_D(QCurlHeader);
-    d->q_ptr = this;
     d->valid = header.d_func()->valid;
     d->values = header.d_func()->values;
 }
@@ -639,9 +1567,14 @@ QCurlHeader::~QCurlHeader()
 
 /*!
     Assigns \a h and returns a reference to this http header.
+
+    Only the header fields are assigned; the request or response line
+    stays as it is.
 */
 QCurlHeader &QCurlHeader::operator=(const QCurlHeader &h)
 {
+    if (d_ptr == h.d_ptr)
+        return *this;
     Q_D(QCurlHeader);
     d->values = h.d_func()->values;
     d->valid = h.d_func()->valid;
@@ -1001,8 +1934,12 @@ void QCurlHeader::setContentType(const QString &type)
 
 class QCurlResponseHeaderPrivate : public QCurlHeaderPrivate
 {
-    Q_DECLARE_PUBLIC(QCurlResponseHeader)
 public:
+    QCurlHeaderPrivate *clone() const
+    { return new QCurlResponseHeaderPrivate(*this); }
+    QCurlHeaderPrivate *create() const
+    { return new QCurlResponseHeaderPrivate(); }
+
     int statCode;
     QString reasonPhr;
     int majVer;
@@ -1049,13 +1986,8 @@ QCurlResponseHeader::QCurlResponseHeader()
     Constructs a copy of \a header.
 */
 QCurlResponseHeader::QCurlResponseHeader(const QCurlResponseHeader &header)
-    : QCurlHeader(*new QCurlResponseHeaderPrivate, header)
+    : QCurlHeader(header)
 {
-    Q_D(QCurlResponseHeader);
-    d->statCode = header.d_func()->statCode;
-    d->reasonPhr = header.d_func()->reasonPhr;
-    d->majVer = header.d_func()->majVer;
-    d->minVer = header.d_func()->minVer;
 }
 
 /*!
@@ -1063,15 +1995,30 @@ QCurlResponseHeader::QCurlResponseHeader(const QCurlResponseHeader &header)
 */
 QCurlResponseHeader &QCurlResponseHeader::operator=(const QCurlResponseHeader &header)
 {
-    Q_D(QCurlResponseHeader);
-    QCurlHeader::operator=(header);
-    d->statCode = header.d_func()->statCode;
-    d->reasonPhr = header.d_func()->reasonPhr;
-    d->majVer = header.d_func()->majVer;
-    d->minVer = header.d_func()->minVer;
+    d_ptr = header.d_ptr;
     return *this;
 }
 
+#ifdef Q_COMPILER_RVALUE_REFS
+/*!
+    Move-constructs a response header from \a header, which is left an
+    empty, invalid response header.
+*/
+QCurlResponseHeader::QCurlResponseHeader(QCurlResponseHeader &&header)
+    : QCurlHeader(std::move(header))
+{
+}
+
+/*!
+    Move-assigns \a header to this response header.
+*/
+QCurlResponseHeader &QCurlResponseHeader::operator=(QCurlResponseHeader &&header)
+{
+    d_ptr.swap(header.d_ptr);
+    return *this;
+}
+#endif
+
 /*!
     Constructs a HTTP response header from the string \a str. The
     string is parsed and the information is set. The \a str should
@@ -1206,8 +2153,12 @@ QString QCurlResponseHeader::toString() const
 
 class QCurlRequestHeaderPrivate : public QCurlHeaderPrivate
 {
-    Q_DECLARE_PUBLIC(QCurlRequestHeader)
 public:
+    QCurlHeaderPrivate *clone() const
+    { return new QCurlRequestHeaderPrivate(*this); }
+    QCurlHeaderPrivate *create() const
+    { return new QCurlRequestHeaderPrivate(); }
+
     QString m;
     QString p;
     int majVer;
@@ -1280,13 +2231,8 @@ QCurlRequestHeader::QCurlRequestHeader(const QString &method, const QString &pat
     Constructs a copy of \a header.
 */
 QCurlRequestHeader::QCurlRequestHeader(const QCurlRequestHeader &header)
-    : QCurlHeader(*new QCurlRequestHeaderPrivate, header)
+    : QCurlHeader(header)
 {
-    Q_D(QCurlRequestHeader);
-    d->m = header.d_func()->m;
-    d->p = header.d_func()->p;
-    d->majVer = header.d_func()->majVer;
-    d->minVer = header.d_func()->minVer;
 }
 
 /*!
@@ -1294,14 +2240,29 @@ QCurlRequestHeader::QCurlRequestHeader(const QCurlRequestHeader &header)
 */
 QCurlRequestHeader &QCurlRequestHeader::operator=(const QCurlRequestHeader &header)
 {
-    Q_D(QCurlRequestHeader);
-    QCurlHeader::operator=(header);
-    d->m = header.d_func()->m;
-    d->p = header.d_func()->p;
-    d->majVer = header.d_func()->majVer;
-    d->minVer = header.d_func()->minVer;
+    d_ptr = header.d_ptr;
+    return *this;
+}
+
+#ifdef Q_COMPILER_RVALUE_REFS
+/*!
+    Move-constructs a request header from \a header, which is left an
+    empty, invalid request header.
+*/
+QCurlRequestHeader::QCurlRequestHeader(QCurlRequestHeader &&header)
+    : QCurlHeader(std::move(header))
+{
+}
+
+/*!
+    Move-assigns \a header to this request header.
+*/
+QCurlRequestHeader &QCurlRequestHeader::operator=(QCurlRequestHeader &&header)
+{
+    d_ptr.swap(header.d_ptr);
     return *this;
 }
+#endif
 
 /*!
     Constructs a HTTP request header from the string \a str. The \a
@@ -1420,60 +2381,198 @@ QString QCurlRequestHeader::toString() const
 
 /****************************************************
  *
- * QCurl
+ * QCurlRequestTemplate
  *
  ****************************************************/
 /*!
-    \class QCurl
-    \obsolete
-    \reentrant
-
-    \brief The QCurl class provides an implementation of the HTTP protocol.
+    \class QCurlRequestTemplate
+    \brief The QCurlRequestTemplate class holds the fixed part of the
+    requests to a frequently used endpoint.
 
-    \ingroup network
     \inmodule QtNetwork
 
+    Building a request through QCurlRequestHeader sets every field and
+    converts the whole header to text again for each call. A template
+    keeps the method and the fields that do not change between calls
+    already serialized; QCurl::request() only appends the path, the Host
+    field, the per request values and the content length to it.
 
-    This class provides a direct interface to HTTP that allows you to
-    download and upload data with the HTTP protocol.
-    However, for new applications, it is
-    recommended to use QNetworkAccessManager and QNetworkReply, as
-    those classes possess a simpler, yet more powerful API
-    and a more modern protocol implementation.
-
-    The class works asynchronously, so there are no blocking
-    functions. If an operation cannot be executed immediately, the
-    function will still return straight away and the operation will be
-    scheduled for later execution. The results of scheduled operations
-    are reported via signals. This approach depends on the event loop
-    being in operation.
+    \code
+    QCurlRequestTemplate status;
+    status.setValue(QLatin1String("Accept"), QLatin1String("application/json"));
 
-    The operations that can be scheduled (they are called "requests"
-    in the rest of the documentation) are the following: setHost(),
-    get(), post(), head() and request().
+    curl->request(status, QLatin1String("/api/status"));
+    curl->request(status, QLatin1String("/api/queue"));
+    \endcode
 
-    All of these requests return a unique identifier that allows you
-    to keep track of the request that is currently executed. When the
-    execution of a request starts, the requestStarted() signal with
-    the identifier is emitted and when the request is finished, the
-    requestFinished() signal is emitted with the identifier and a bool
-    that indicates if the request finished with an error.
+    Templates are implicitly shared; a request keeps the template it was
+    made from, so changing a template does not affect the requests that
+    are already queued.
 
-    To make an HTTP request you must set up suitable HTTP headers. The
-    following example demonstrates how to request the main HTML page
-    from the Qt website (i.e., the URL \c http://qt.digia.com/index.html):
+    \sa QCurl::request()
+*/
 
-    \snippet doc/src/snippets/code/src_network_access_QCurl.cpp 2
+/*!
+    Constructs a template for GET requests on a kept-alive connection.
+*/
+QCurlRequestTemplate::QCurlRequestTemplate()
+    : d(new QCurlRequestTemplatePrivate)
+{
+    d->prototype.setRequest(QLatin1String("GET"), QString());
+    d->prototype.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
+    d->serializeFields();
+}
 
-    For the common HTTP requests \c GET, \c POST and \c HEAD, QCurl
-    provides the convenience functions get(), post() and head(). They
-    already use a reasonable header and if you don't have to set
-    special header fields, they are easier to use. The above example
-    can also be written as:
+/*!
+    Constructs a template for requests with the method \a method on a
+    kept-alive connection.
+*/
+QCurlRequestTemplate::QCurlRequestTemplate(const QString &method)
+    : d(new QCurlRequestTemplatePrivate)
+{
+    d->prototype.setRequest(method, QString());
+    d->prototype.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
+    d->serializeFields();
+}
 
-    \snippet doc/src/snippets/code/src_network_access_QCurl.cpp 3
+/*!
+    Constructs a copy of \a other.
+*/
+QCurlRequestTemplate::QCurlRequestTemplate(const QCurlRequestTemplate &other)
+    : d(other.d)
+{
+}
 
-    For this example the following sequence of signals is emitted
+/*!
+    Destroys the template.
+*/
+QCurlRequestTemplate::~QCurlRequestTemplate()
+{
+}
+
+/*!
+    Assigns \a other to this template and returns a reference to it.
+*/
+QCurlRequestTemplate &QCurlRequestTemplate::operator=(const QCurlRequestTemplate &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+    Returns the method of the requests made from this template.
+*/
+QString QCurlRequestTemplate::method() const
+{
+    return d->prototype.method();
+}
+
+/*!
+    Sets the fixed header field \a key to \a value. The Host and
+    content-length fields are set for each request; setting either of
+    them here (in any letter case) is ignored with a warning.
+
+    \sa value() removeValue()
+*/
+void QCurlRequestTemplate::setValue(const QString &key, const QString &value)
+{
+    if (qt_curl_isGeneratedField(key.toLatin1())) {
+        qWarning("QCurlRequestTemplate::setValue: the %s field is set by QCurl", qPrintable(key));
+        return;
+    }
+    d->prototype.setValue(key, value);
+    d->serializeFields();
+}
+
+/*!
+    Returns the value of the fixed header field \a key.
+
+    \sa setValue()
+*/
+QString QCurlRequestTemplate::value(const QString &key) const
+{
+    return d->prototype.value(key);
+}
+
+/*!
+    Removes the fixed header field \a key.
+
+    \sa setValue()
+*/
+void QCurlRequestTemplate::removeValue(const QString &key)
+{
+    d->prototype.removeValue(key);
+    d->serializeFields();
+}
+
+/*!
+    Returns the request header of a request for \a path made from this
+    template, without the fields that are only known when it is sent.
+*/
+QCurlRequestHeader QCurlRequestTemplate::header(const QString &path) const
+{
+    QCurlRequestHeader h = d->prototype;
+    h.setRequest(h.method(), path.isEmpty() ? QString::fromLatin1("/") : path);
+    return h;
+}
+
+
+/****************************************************
+ *
+ * QCurl
+ *
+ ****************************************************/
+/*!
+    \class QCurl
+    \obsolete
+    \reentrant
+
+    \brief The QCurl class provides an implementation of the HTTP protocol.
+
+    \ingroup network
+    \inmodule QtNetwork
+
+
+    This class provides a direct interface to HTTP that allows you to
+    download and upload data with the HTTP protocol.
+    However, for new applications, it is
+    recommended to use QNetworkAccessManager and QNetworkReply, as
+    those classes possess a simpler, yet more powerful API
+    and a more modern protocol implementation.
+
+    The class works asynchronously, so there are no blocking
+    functions. If an operation cannot be executed immediately, the
+    function will still return straight away and the operation will be
+    scheduled for later execution. The results of scheduled operations
+    are reported via signals. This approach depends on the event loop
+    being in operation.
+
+    The operations that can be scheduled (they are called "requests"
+    in the rest of the documentation) are the following: setHost(),
+    get(), post(), head() and request().
+
+    All of these requests return a unique identifier that allows you
+    to keep track of the request that is currently executed. When the
+    execution of a request starts, the requestStarted() signal with
+    the identifier is emitted and when the request is finished, the
+    requestFinished() signal is emitted with the identifier and a bool
+    that indicates if the request finished with an error.
+
+    To make an HTTP request you must set up suitable HTTP headers. The
+    following example demonstrates how to request the main HTML page
+    from the Qt website (i.e., the URL \c http://qt.digia.com/index.html):
+
+    \snippet doc/src/snippets/code/src_network_access_QCurl.cpp 2
+
+    For the common HTTP requests \c GET, \c POST and \c HEAD, QCurl
+    provides the convenience functions get(), post() and head(). They
+    already use a reasonable header and if you don't have to set
+    special header fields, they are easier to use. The above example
+    can also be written as:
+
+    \snippet doc/src/snippets/code/src_network_access_QCurl.cpp 3
+
+    For this example the following sequence of signals is emitted
     (with small variations, depending on network traffic, etc.):
 
     \snippet doc/src/snippets/code/src_network_access_QCurl.cpp 4
@@ -1497,7 +2596,8 @@ QString QCurlRequestHeader::toString() const
     If an error occurs during the execution of one of the commands in
     a sequence of commands, all the pending commands (i.e. scheduled,
     but not yet executed commands) are cleared and no signals are
-    emitted for them.
+    emitted for them. With setErrorPolicy(ContinueOnError) only the
+    failing request is finished and the next one is started instead.
 
     For example, if you have the following sequence of requests
 
@@ -1578,6 +2678,17 @@ QCurl::QCurl(const QString &hostName, ConnectionMode mode, quint16 port, QObject
     d->mode = mode;
 }
 
+QCurlPrivate::~QCurlPrivate()
+{
+    // requests queued while the QCurl destructor aborted the others
+    detachAwaiters();
+    while (!pending.isEmpty())
+        discardRequest(pending.takeFirst());
+
+    if (deleteSocket)
+        delete socket;
+}
+
 void QCurlPrivate::init()
 {
     Q_Q(QCurl);
@@ -1585,6 +2696,24 @@ void QCurlPrivate::init()
     QMetaObject::invokeMethod(q, "_q_slotDoFinished", Qt::QueuedConnection);
     post100ContinueTimer.setSingleShot(true);
     QObject::connect(&post100ContinueTimer, SIGNAL(timeout()), q, SLOT(_q_continuePost()));
+    idleTimer.setSingleShot(true);
+    QObject::connect(&idleTimer, SIGNAL(timeout()), q, SLOT(_q_slotIdleTimeout()));
+    transferTimer.setSingleShot(true);
+    QObject::connect(&transferTimer, SIGNAL(timeout()), q, SLOT(_q_slotTransferTimeout()));
+    phaseTimer.setSingleShot(true);
+    QObject::connect(&phaseTimer, SIGNAL(timeout()), q, SLOT(_q_slotPhaseTimeout()));
+    retryTimer.setSingleShot(true);
+    QObject::connect(&retryTimer, SIGNAL(timeout()), q, SLOT(_q_slotRetry()));
+    hedgeTimer.setSingleShot(true);
+    QObject::connect(&hedgeTimer, SIGNAL(timeout()), q, SLOT(_q_slotHedge()));
+    readPaceTimer.setSingleShot(true);
+    QObject::connect(&readPaceTimer, SIGNAL(timeout()), q, SLOT(_q_slotPaceRead()));
+    writePaceTimer.setSingleShot(true);
+    QObject::connect(&writePaceTimer, SIGNAL(timeout()), q, SLOT(_q_slotPaceWrite()));
+    requestPaceTimer.setSingleShot(true);
+    QObject::connect(&requestPaceTimer, SIGNAL(timeout()), q, SLOT(_q_startNextRequest()));
+    notifyTimer.setSingleShot(true);
+    QObject::connect(&notifyTimer, SIGNAL(timeout()), q, SLOT(_q_slotFlushNotifications()));
 }
 
 /*!
@@ -1593,6 +2722,7 @@ void QCurlPrivate::init()
 */
 QCurl::~QCurl()
 {
+    d->detachAwaiters();
     abort();
 }
 
@@ -1647,12 +2777,75 @@ QCurl::~QCurl()
     proxy server requires authentication to establish a connection.
     \value AuthenticationRequiredError The web server requires authentication
     to complete the request.
+    \value TimeoutError The request did not complete within one of the
+    limits set with setTimeout() or setRequestTimeout().
     \value UnknownError An error other than those specified above
     occurred.
 
     \sa error()
 */
 
+/*!
+    \enum QCurl::ErrorPolicy
+
+    This enum decides what happens to the scheduled requests when a
+    request fails:
+
+    \value AbortPendingOnError All pending requests are deleted and done()
+    is emitted. This is the default.
+    \value ContinueOnError Only the failing request is finished; its
+    connection is dropped and the next request is started. done() is
+    emitted with \c true once the queue is empty if any request failed.
+
+    \sa setErrorPolicy()
+*/
+
+/*!
+    \enum QCurl::Timeout
+
+    This enum identifies the limits that can be put on a request with
+    setTimeout() and setRequestTimeout():
+
+    \value TransferTimeout The total time the request may take, from the
+    moment it starts until the response has been read completely.
+    \value HostLookupTimeout The time allowed for resolving the host name.
+    \value ConnectTimeout The time allowed for establishing the TCP connection.
+    \value EncryptionTimeout The time allowed for the SSL handshake.
+    \value FirstByteTimeout The time allowed between sending the request
+    and receiving the first byte of the response. Upload progress restarts it.
+    \value ReadIdleTimeout The longest pause allowed between two reads while
+    the response is being received.
+
+    \sa TimeoutError
+*/
+
+/*!
+    \enum QCurl::SocketOption
+
+    This enum describes the socket options that can be set with
+    setSocketOption():
+
+    \value LowDelayOption Set to 1 to send small writes at once, disabling
+    Nagle's algorithm (TCP_NODELAY). Helps small requests whose header and
+    body are written separately.
+    \value SendBufferSizeOption The size of the kernel's send buffer in
+    bytes (SO_SNDBUF).
+    \value ReceiveBufferSizeOption The size of the kernel's receive buffer
+    in bytes (SO_RCVBUF). Larger buffers help bulk transfers.
+    \value QuickAckOption Set to 1 to acknowledge received data right away
+    instead of delaying the acknowledgement (TCP_QUICKACK, Linux only).
+    \value FastOpenOption Set to 1 to send the request with the connection
+    setup when the server allowed TCP Fast Open before
+    (TCP_FASTOPEN_CONNECT, Linux only).
+    \value KeepAliveOption Set to 1 to have the kernel probe idle
+    connections (SO_KEEPALIVE).
+    \value KeepAliveIdleOption The seconds a connection is idle before it
+    is probed.
+    \value KeepAliveIntervalOption The seconds between two probes.
+    \value KeepAliveCountOption The number of unanswered probes after
+    which the connection is dropped.
+*/
+
 /*!
     \fn void QCurl::stateChanged(int state)
 
@@ -1754,6 +2947,16 @@ QCurl::~QCurl()
     \sa requestStarted() done() error() errorString()
 */
 
+/*!
+    \fn void QCurl::batchFinished(int batchId, int failed)
+
+    This signal is emitted when every request of the batch identified
+    by \a batchId has finished; \a failed of them finished with an
+    error, including the ones that were cancelled or aborted.
+
+    \sa submitBatch()
+*/
+
 /*!
     \fn void QCurl::done(bool error)
 
@@ -1825,14 +3028,14 @@ QCurl::~QCurl()
     requests left and the done() signal is emitted (with the \c error
     argument \c true).
 
-    \sa clearPendingRequests()
+    \sa clearPendingRequests() cancel()
 */
 void QCurl::abort()
 {
     if (d->pending.isEmpty())
         return;
 
-    d->finishedWithError(tr("Request aborted"), Aborted);
+    d->finishedAllWithError(tr("Request aborted"), Aborted);
     clearPendingRequests();
     if (d->socket)
         d->socket->abort();
@@ -1882,6 +3085,8 @@ qint64 QCurl::read(char *data, qint64 maxlen)
     }
 
     d->bytesDone += maxlen;
+    if (d->readPaused)
+        d->resumeReading();
 #if defined(QCurl_DEBUG)
     qDebug("QCurl::read(): read %lld bytes (%lld bytes done)", maxlen, d->bytesDone);
 #endif
@@ -1997,16 +3202,152 @@ bool QCurl::hasPendingRequests() const
 /*!
     Deletes all pending requests from the list of scheduled requests.
     This does not affect the request that is being executed. If
-    you want to stop this as well, use abort().
+    you want to stop this as well, use abort(). To remove a single
+    request, use cancel().
 
-    \sa hasPendingRequests() abort()
+    \sa hasPendingRequests() abort() cancel()
 */
 void QCurl::clearPendingRequests()
 {
     // delete all entires except the first one
     while (d->pending.count() > 1)
-        delete d->pending.takeLast();
+        d->discardRequest(d->pending.takeLast());
+}
+
+/*!
+    Cancels the request identified by \a id, leaving all other requests
+    scheduled.
+
+    A request that has not been started yet is removed from the list of
+    scheduled requests and no signals are emitted for it. If \a id is
+    the request being executed, the requestFinished() signal is emitted
+    for it with the \c error argument \c true, error() returns Aborted
+    and the next scheduled request is started. If only a small part of
+    the response body is still outstanding, it is read and discarded
+    before that happens, so that the connection can be reused by the
+    next request; otherwise the connection is closed.
+
+    Returns false if there is no such request or if it has already
+    finished.
+
+    \sa abort() clearPendingRequests()
+*/
+bool QCurl::cancel(int id)
+{
+    int i = d->indexOf(id);
+    if (i == -1)
+        return false;
+    if (i == 0)
+        return d->cancelCurrent();
+    d->discardRequest(d->pending.takeAt(i));
+    return true;
+}
+
+/*!
+    Makes \a awaiter follow the request identified by \a id: it is told
+    about response data as soon as it is buffered and gets the reply
+    when the request finishes, including when it is cancelled or
+    aborted. Both calls are made without going through signals, right
+    after the network event that caused them, once QCurl is done with
+    the request; a coroutine (see qcurlcoro.h) that is resumed may
+    delete this object or abort its queue. The reply of a request still
+    pending when this object is destroyed is delivered from the event
+    loop once the object is gone. Passing 0 removes the awaiter, and
+    drops calls that were not made yet.
+
+    The reply takes over the response data that is still buffered when
+    the request finishes, as for future().
+
+    Returns false if there is no such request or it already finished.
+
+    \sa QCurlAwaiter future()
+*/
+bool QCurl::setAwaiter(int id, QCurlAwaiter *awaiter)
+{
+    // calls still queued for the previous awaiter are not made anymore
+    for (int j = d->awaiterCalls.count() - 1; j >= 0; --j) {
+        if (d->awaiterCalls.at(j).id == id)
+            d->awaiterCalls.removeAt(j);
+    }
+    int i = d->indexOf(id);
+    if (i == -1 || d->pending.at(i)->finished || d->pending.at(i)->quiet)
+        return false;
+    d->pending.at(i)->awaiter = awaiter;
+    return true;
+}
+
+/*!
+    Makes \a sink receive the response of the request identified by \a
+    id instead of the device passed with the request or read(): its
+    functions are called straight from the code reading the socket,
+    with the data in QCurl's own receive buffer. Passing 0 removes the
+    sink.
+
+    The sink is told about the response header, then about every piece
+    of the body as it arrives, and once about the outcome, including
+    when the request is cancelled or aborted. Since nothing is buffered,
+    readyRead() is not emitted for the request, and an awaiter or future
+    of it gets an empty body. Progress is still reported through
+    dataReadProgress().
+
+    Returns false if there is no such request or it has already
+    finished.
+
+    \sa QCurlSink
+*/
+bool QCurl::setSink(int id, QCurlSink *sink)
+{
+    int i = d->indexOf(id);
+    if (i == -1 || d->pending.at(i)->finished)
+        return false;
+    d->pending.at(i)->sink = sink;
+    return true;
+}
+
+#ifndef QT_NO_QFUTURE
+/*!
+    Returns a future for the request identified by \a id. It finishes
+    when the request does, with a QCurlReply holding the response
+    header and body or the error; a request that is cancelled, cleared
+    or aborted before it ran reports Aborted. Several calls for the same
+    request return the same future.
+
+    This avoids keeping track of request identifiers in slots:
+
+    \code
+    QFuture<QCurlReply> reply = curl->future(curl->get("/index.html"));
+    QFutureWatcher<QCurlReply> *watcher = new QFutureWatcher<QCurlReply>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(pageArrived()));
+    watcher->setFuture(reply);
+    \endcode
+
+    The reply takes over the response data that is still buffered when
+    the request finishes. Data already fetched with read() or readAll(),
+    or written to a destination device, is not part of it. The reply is
+    implicitly shared, so handing it on does not copy the body.
+
+    If there is no such request, an already finished future with an
+    invalid reply is returned.
+
+    \sa requestFinished() QCurlReply
+*/
+QFuture<QCurlReply> QCurl::future(int id)
+{
+    QHash<int, QFutureInterface<QCurlReply> >::ConstIterator it = d->futures.constFind(id);
+    if (it != d->futures.constEnd())
+        return it->future();
+
+    QFutureInterface<QCurlReply> promise;
+    promise.reportStarted();
+    if (d->indexOf(id) == -1) {
+        promise.reportResult(QCurlReply());
+        promise.reportFinished();
+    } else {
+        d->futures.insert(id, promise);
+    }
+    return promise.future();
 }
+#endif
 
 /*!
     Sets the HTTP server that is used for requests to \a hostName on
@@ -2057,6 +3398,34 @@ int QCurl::setHost(const QString &hostName, ConnectionMode mode, quint16 port)
     return d->addRequest(new QCurlSetHostRequest(hostName, port, mode));
 }
 
+/*!
+    Sets the HTTP server that is used for requests to the local socket
+    \a serverName, which is the path of a Unix domain socket. On Linux,
+    a name starting with '@' refers to a socket in the abstract namespace
+    instead (for example \c{@app.sock}). \a hostName is sent in the Host
+    field of the requests; it defaults to \c localhost.
+
+    Requests to a local server behave like the ones to a TCP server: the
+    connection is kept alive and reused as long as the server allows it.
+    Proxies and HTTPS are not used for local servers. Calling setHost()
+    switches back to TCP.
+
+    This is not supported on platforms other than Unix, where the request
+    fails.
+
+    The function does not block; instead, it returns immediately. The request
+    is scheduled, and its execution is performed asynchronously. The
+    function returns a unique identifier which is passed by
+    requestStarted() and requestFinished().
+
+    \sa setHost() setSocket()
+*/
+int QCurl::setLocalServer(const QString &serverName, const QString &hostName)
+{
+    return d->addRequest(new QCurlSetHostRequest(hostName.isEmpty() ? QString::fromLatin1("localhost") : hostName,
+                                                 80, ConnectionModeHttp, serverName));
+}
+
 /*!
     Replaces the internal QTcpSocket that QCurl uses with \a
     socket. This is useful if you want to use your own custom QTcpSocket
@@ -2076,7 +3445,7 @@ int QCurl::setHost(const QString &hostName, ConnectionMode mode, quint16 port)
     Note: If QCurl is used in a non-GUI thread that runs its own event
     loop, you must move \a socket to that thread before calling setSocket().
 
-    \sa QObject::moveToThread(), {Thread Support in Qt}
+    \sa QCurlLoopbackSocket, QCurlEpollSocket, QObject::moveToThread(), {Thread Support in Qt}
 */
 int QCurl::setSocket(QTcpSocket *socket)
 {
@@ -2185,7 +3554,9 @@ int QCurl::get(const QString &path, QIODevice *to)
 {
     QCurlRequestHeader header(QLatin1String("GET"), path);
     header.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
-    return d->addRequest(new QCurlPGHRequest(header, (QIODevice *) 0, to));
+    QCurlPGHRequest *req = new QCurlPGHRequest(header, (QIODevice *) 0, to);
+    req->hedgeable = true;
+    return d->addRequest(req);
 }
 
 /*!
@@ -2234,7 +3605,65 @@ int QCurl::post(const QString &path, const QByteArray &data, QIODevice *to)
 {
     QCurlRequestHeader header(QLatin1String("POST"), path);
     header.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
-    return d->addRequest(new QCurlPGHRequest(header, new QByteArray(data), to));
+    return d->addRequest(new QCurlPGHRequest(header, data, to));
+}
+
+#ifdef Q_COMPILER_RVALUE_REFS
+/*!
+    \overload
+
+    The request takes over \a data, so that nothing of a large upload is
+    copied, not even when the caller would modify a shared copy of it
+    before it is sent.
+*/
+int QCurl::post(const QString &path, QByteArray &&data, QIODevice *to)
+{
+    QCurlRequestHeader header(QLatin1String("POST"), path);
+    header.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
+    return d->addRequest(new QCurlPGHRequest(header, std::move(data), to));
+}
+#endif
+
+/*!
+    \overload
+
+    Sends a request for \a path made from the template \a tmpl to the
+    server set with setHost(). If \a data is not null, it is sent as
+    the content of the request. If \a to is 0 the response content is
+    read into an internal buffer, otherwise it is written to \a to.
+
+    The header is not assembled field by field: the fixed fields of \a
+    tmpl are sent as the template serialized them, followed by the Host
+    field and the content length. Only a proxy or an authenticator,
+    which modify the header, make the request fall back to a full
+    QCurlRequestHeader.
+
+    \sa QCurlRequestTemplate
+*/
+int QCurl::request(const QCurlRequestTemplate &tmpl, const QString &path,
+                   const QByteArray &data, QIODevice *to)
+{
+    // not the QCurlNormalRequest overload: the path needs no check, and
+    // building the full header for it would allocate for every request
+    QCurlRequest *r = new QCurlTemplateRequest(tmpl, path, QList<QPair<QByteArray, QByteArray> >(), data, to);
+    return d->addRequest(r);
+}
+
+/*!
+    \overload
+
+    The header fields in \a values are sent in addition to the fixed
+    fields of \a tmpl, for this request only. Keys and values are sent
+    as they are and must be valid header text. Host and content-length
+    entries are dropped with a warning, as QCurl writes those fields
+    itself.
+*/
+int QCurl::request(const QCurlRequestTemplate &tmpl, const QString &path,
+                   const QList<QPair<QByteArray, QByteArray> > &values,
+                   const QByteArray &data, QIODevice *to)
+{
+    QCurlRequest *r = new QCurlTemplateRequest(tmpl, path, values, data, to);
+    return d->addRequest(r);
 }
 
 /*!
@@ -2301,7 +3730,132 @@ int QCurl::request(const QCurlRequestHeader &header, QIODevice *data, QIODevice
 */
 int QCurl::request(const QCurlRequestHeader &header, const QByteArray &data, QIODevice *to )
 {
-    return d->addRequest(new QCurlNormalRequest(header, new QByteArray(data), to));
+    return d->addRequest(new QCurlNormalRequest(header, data, to));
+}
+
+#ifdef Q_COMPILER_RVALUE_REFS
+/*!
+    \overload
+
+    The request takes over \a data instead of sharing it with the
+    caller.
+*/
+int QCurl::request(const QCurlRequestHeader &header, QByteArray &&data, QIODevice *to)
+{
+    return d->addRequest(new QCurlNormalRequest(header, std::move(data), to));
+}
+#endif
+
+/*!
+    Sends the request \a header with the content \a data to the server
+    and blocks until the response is complete, for at most \a msecs
+    milliseconds (0 means no limit besides the timeouts set with
+    setTimeout()). Returns the response header and body, or the error;
+    an exceeded deadline reports TimeoutError.
+
+    This is meant for worker threads that do not run an event loop:
+    the socket is driven with its blocking functions, and what would
+    otherwise go through queued calls and timers is run directly from
+    within this call. The usual signals are still emitted, from within
+    this call as well. Hedging is not used for these requests and the
+    limit set with setReadBufferSize() does not apply, since the body is
+    only handed out at the end.
+
+    \code
+    QCurl curl(QLatin1String("example.com"));
+    QCurlRequestHeader header(QLatin1String("GET"), QLatin1String("/index.html"));
+    header.setValue(QLatin1String("Host"), QLatin1String("example.com"));
+    QCurlReply reply = curl.execute(header);
+    if (reply.error() == QCurl::NoError)
+        process(reply.body());
+    \endcode
+
+    The object must not have other requests pending, and must live in
+    the calling thread.
+
+    \sa request()
+*/
+QCurlReply QCurl::execute(const QCurlRequestHeader &header, const QByteArray &data, int msecs)
+{
+    if (d->synchronous || !d->pending.isEmpty()) {
+        qWarning("QCurl::execute: requests are pending");
+        return QCurlReply(0, UnknownError,
+                          QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Requests are pending")),
+                          QCurlResponseHeader(), QByteArray());
+    }
+
+    QCurlSyncAwaiter awaiter;
+    d->synchronous = true;
+    d->addRequest(new QCurlNormalRequest(header, data, 0));
+    d->pending.first()->awaiter = &awaiter;
+    d->runSynchronously(&awaiter, msecs);
+    d->synchronous = false;
+    return awaiter.reply;
+}
+
+/*!
+    \class QCurlRequestDescriptor
+    \brief The QCurlRequestDescriptor struct describes one request of a
+    batch passed to QCurl::submitBatch().
+
+    It holds the method, the path and the content data of the request.
+*/
+
+/*!
+    Queues the HTTP requests described by \a requests and returns an
+    identifier for the batch; requests without a method are GET
+    requests. The Host header is set as for get(), and a request with
+    null data sends no content.
+
+    The requests are allocated in one block and scheduled together,
+    and they are reported as a whole: no requestStarted(),
+    requestFinished() or readyRead() signal is emitted for them, and
+    batchFinished() is emitted once the last one finished. Their
+    response bodies are not made available through read().
+
+    Returns 0 without doing anything if \a requests is empty.
+
+    \sa batchFinished()
+*/
+int QCurl::submitBatch(const QVector<QCurlRequestDescriptor> &requests)
+{
+    return submitBatch(requests, 0, std::function<void(int, const QCurlReply &)>());
+}
+
+/*!
+    \overload
+
+    Also calls \a callback with the index of each request in \a
+    requests and its reply as soon as the request finished, from the
+    thread of this object. If \a context is not 0, nothing is called
+    anymore once it is destroyed. Neither is anything called for the
+    requests that are aborted when this object is destroyed.
+
+    \code
+    QVector<QCurlRequestDescriptor> requests;
+    for (int i = 0; i < paths.count(); ++i)
+        requests.append(QCurlRequestDescriptor(QString(), paths.at(i)));
+    curl->submitBatch(requests, this, [this](int index, const QCurlReply &reply) {
+        store(index, reply.body());
+    });
+    \endcode
+*/
+int QCurl::submitBatch(const QVector<QCurlRequestDescriptor> &requests, const QObject *context,
+                       std::function<void(int index, const QCurlReply &reply)> callback)
+{
+    if (requests.isEmpty())
+        return 0;
+
+    QCurlBatch *batch = new QCurlBatch(this, requests.count());
+    batch->hasContext = context != 0;
+    batch->context = context;
+    batch->callback = callback;
+
+    QVector<QCurlRequest *> reqs(requests.count());
+    for (int i = 0; i < requests.count(); ++i)
+        reqs[i] = batch->create(i, requests.at(i));
+    d->addRequests(reqs);
+    return batch->id;
 }
 
 /*!
@@ -2343,226 +3897,1955 @@ int QCurl::closeConnection()
     return d->addRequest(new QCurlCloseRequest());
 }
 
-int QCurlPrivate::addRequest(QCurlNormalRequest *req)
-{
-    QCurlRequestHeader h = req->requestHeader();
-    if (h.path().isEmpty()) {
-        // note: the following qWarning is autotested. If you change it, change the test too.
-        qWarning("QCurl: empty path requested is invalid -- using '/'");
-        h.setRequest(h.method(), QLatin1String("/"), h.majorVersion(), h.minorVersion());
-        req->setRequestHeader(h);
-    }
+/*!
+    Sets the maximum time in milliseconds a keep-alive connection may stay
+    idle between two requests to \a msecs. When the limit is reached the
+    connection is closed, so that the next request opens a fresh one
+    instead of writing to a socket the server has given up on.
 
-    // contine below
-    return addRequest(static_cast<QCurlRequest *>(req));
-}
+    Independently of this setting QCurl honours the \c timeout and \c max
+    parameters of a \c Keep-Alive response header, closing the connection
+    slightly before the server would. A value of 0 (the default) only
+    applies the server's hint.
 
-int QCurlPrivate::addRequest(QCurlRequest *req)
+    \sa keepAliveTimeout() close()
+*/
+void QCurl::setKeepAliveTimeout(int msecs)
 {
-    Q_Q(QCurl);
-    pending.append(req);
-
-    if (pending.count() == 1) {
-        // don't emit the requestStarted() signal before the id is returned
-        QMetaObject::invokeMethod(q, "_q_startNextRequest", Qt::QueuedConnection);
-    }
-    return req->id;
+    d->idleTimeout = qMax(0, msecs);
 }
 
-void QCurlPrivate::_q_startNextRequest()
-{
+/*!
+    Returns the local idle limit for keep-alive connections in
+    milliseconds, or 0 if only the server's hint is applied.
+
+    \sa setKeepAliveTimeout()
+*/
+int QCurl::keepAliveTimeout() const
+{
+    return d->idleTimeout;
+}
+
+/*!
+    Sets the default limit of type \a type to \a msecs milliseconds for
+    all requests of this object. A value of 0 (the default) disables the
+    limit.
+
+    When a limit is exceeded only the affected request fails, with the
+    error TimeoutError; its connection is dropped and the remaining
+    requests are processed as usual.
+
+    \sa timeout() setRequestTimeout() Timeout
+*/
+void QCurl::setTimeout(Timeout type, int msecs)
+{
+    if (uint(type) >= uint(QCurlTimeoutCount)) {
+        qWarning("QCurl::setTimeout: invalid timeout type %d", int(type));
+        return;
+    }
+    d->timeouts[type] = qMax(0, msecs);
+}
+
+/*!
+    Returns the default limit of type \a type in milliseconds, or 0 if
+    there is none.
+
+    \sa setTimeout()
+*/
+int QCurl::timeout(Timeout type) const
+{
+    if (uint(type) >= uint(QCurlTimeoutCount))
+        return 0;
+    return d->timeouts[type];
+}
+
+/*!
+    Overrides the limit of type \a type for the request identified by
+    \a id with \a msecs milliseconds; 0 disables the limit for that
+    request and a negative value restores the default set with
+    setTimeout(). The override applies to the phases the request enters
+    after the call, so it is best done right after the request has been
+    scheduled.
+
+    Returns false if no request with this identifier is scheduled.
+
+    \sa setTimeout()
+*/
+bool QCurl::setRequestTimeout(int id, Timeout type, int msecs)
+{
+    if (uint(type) >= uint(QCurlTimeoutCount)) {
+        qWarning("QCurl::setRequestTimeout: invalid timeout type %d", int(type));
+        return false;
+    }
+    for (int i = 0; i < d->pending.count(); ++i) {
+        QCurlRequest *r = d->pending.at(i);
+        if (r->id == id) {
+            r->timeouts[type] = msecs < 0 ? -1 : msecs;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+    Sets the policy applied to the scheduled requests when a request
+    fails to \a policy.
+
+    With the default, AbortPendingOnError, a failure clears the whole
+    queue. ContinueOnError isolates the failure: requestFinished() is
+    emitted with \c error set to \c true for the failing request only and
+    processing continues with the next scheduled request. abort() always
+    clears the queue.
+
+    \sa errorPolicy() abort() clearPendingRequests()
+*/
+void QCurl::setErrorPolicy(ErrorPolicy policy)
+{
+    d->errorPolicy = policy;
+}
+
+/*!
+    Returns the policy applied to the scheduled requests when a request
+    fails.
+
+    \sa setErrorPolicy()
+*/
+QCurl::ErrorPolicy QCurl::errorPolicy() const
+{
+    return d->errorPolicy;
+}
+
+/*!
+    Sets the retry policy applied to the requests of this object to \a
+    policy. QCurl does not take ownership of the policy; it must stay
+    valid while requests are being processed. Passing 0 (the default)
+    disables retries, apart from the silent reconnect QCurl does when a
+    kept-alive connection turns out to be closed.
+
+    A request is only retried as long as nothing of its response has
+    been reported yet, and only if its source device (if any) can be
+    rewound.
+
+    \sa retryPolicy() setRequestRetryPolicy() QCurlRetryPolicy
+*/
+void QCurl::setRetryPolicy(QCurlRetryPolicy *policy)
+{
+    d->retryPolicy = policy;
+}
+
+/*!
+    Returns the retry policy of this object, or 0 if none is set.
+
+    \sa setRetryPolicy()
+*/
+QCurlRetryPolicy *QCurl::retryPolicy() const
+{
+    return d->retryPolicy;
+}
+
+/*!
+    Uses \a policy instead of the object's retry policy for the request
+    identified by \a id; 0 disables retries for that request.
+
+    Returns false if no request with this identifier is scheduled.
+
+    \sa setRetryPolicy()
+*/
+bool QCurl::setRequestRetryPolicy(int id, QCurlRetryPolicy *policy)
+{
+    for (int i = 0; i < d->pending.count(); ++i) {
+        QCurlRequest *r = d->pending.at(i);
+        if (r->id == id) {
+            r->retryPolicy = policy;
+            r->retryPolicySet = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+    If \a enable is true, requests made with get() are hedged: when the
+    response header has not arrived after the hedgingPercentile() of the
+    header latencies observed recently, the same request is sent on a
+    second connection, to the host set with setHedgingHost() or to the
+    same host. The first complete response is reported as the response
+    of the request: while the duplicate runs, the response header and
+    body of the original are held back. The duplicate is cancelled as
+    with cancel() when it loses, so its connection is kept if the rest
+    of its response is small; the original's connection is closed when
+    the duplicate wins.
+
+    Hedging starts once a few latencies have been measured. It is
+    meant for idempotent requests against replicated servers. The
+    duplicate carries the full header of the original request, Host
+    field included, but not its source and destination devices.
+
+    \sa isHedgingEnabled() setHedgingPercentile() setHedgingHost()
+*/
+void QCurl::setHedgingEnabled(bool enable)
+{
+    d->hedgingEnabled = enable;
+    if (!enable)
+        d->cancelHedge();
+}
+
+/*!
+    Returns true if requests made with get() are hedged.
+
+    \sa setHedgingEnabled()
+*/
+bool QCurl::isHedgingEnabled() const
+{
+    return d->hedgingEnabled;
+}
+
+/*!
+    Sets the percentile of recent response header latencies after which
+    a hedged request is duplicated to \a percentile. The default is 95,
+    so that about one request in twenty is sent twice.
+
+    \sa setHedgingEnabled()
+*/
+void QCurl::setHedgingPercentile(int percentile)
+{
+    d->hedgingPercentile = qBound(1, percentile, 100);
+}
+
+/*!
+    Returns the percentile of recent response header latencies after
+    which a hedged request is duplicated.
+
+    \sa setHedgingPercentile()
+*/
+int QCurl::hedgingPercentile() const
+{
+    return d->hedgingPercentile;
+}
+
+/*!
+    Sends the duplicates of hedged requests to \a hostName on port \a
+    port, typically another replica of the server. With an empty \a
+    hostName (the default) they go to the host of the request on a
+    second connection. If \a port is 0 the port of the request is used.
+
+    \sa setHedgingEnabled()
+*/
+void QCurl::setHedgingHost(const QString &hostName, quint16 port)
+{
+    d->hedgeHost = hostName;
+    d->hedgePort = port;
+}
+
+/*!
+    Sets the priority of the scheduled request identified by \a id to \a
+    priority. Requests with a higher priority are started before those
+    with a lower one, so an interactive request does not have to wait
+    behind a queue of bulk transfers. Requests default to NormalPriority.
+
+    The request being executed is not affected, and a request never moves
+    past a setHost(), setUser(), setProxy(), setSocket() or close()
+    request scheduled before or after it.
+
+    Returns false if no request with this identifier is scheduled.
+
+    \sa priority() setRequestFlow()
+*/
+bool QCurl::setPriority(int id, Priority priority)
+{
+    int i = d->indexOf(id);
+    if (i == -1)
+        return false;
+    QCurlRequest *r = d->pending.at(i);
+    r->priority = priority;
+    if (i > 0 && r->hasRequestHeader())
+        d->reposition(i);
+    return true;
+}
+
+/*!
+    Returns the priority of the scheduled request identified by \a id, or
+    NormalPriority if there is no such request.
+
+    \sa setPriority()
+*/
+QCurl::Priority QCurl::priority(int id) const
+{
+    int i = d->indexOf(id);
+    return i == -1 ? NormalPriority : d->pending.at(i)->priority;
+}
+
+/*!
+    Assigns the scheduled request identified by \a id to the flow \a
+    flow, for instance a host name or a tenant. Within a priority, flows
+    share the queue in proportion to their weights (weighted fair
+    queuing), so one flow submitting many requests cannot starve the
+    others. Requests that are not assigned a flow share a single default
+    flow and keep their submission order.
+
+    Returns false if no request with this identifier is scheduled.
+
+    \sa setFlowWeight() setPriority()
+*/
+bool QCurl::setRequestFlow(int id, const QString &flow)
+{
+    int i = d->indexOf(id);
+    if (i == -1)
+        return false;
+    QCurlRequest *r = d->pending.at(i);
+    r->flow = flow;
+    if (i > 0 && r->hasRequestHeader()) {
+        d->assignFinishTag(r);
+        d->reposition(i);
+    }
+    return true;
+}
+
+/*!
+    Sets the weight of the flow \a flow to \a weight. A flow with weight
+    2 gets twice as many requests started as a flow with weight 1 while
+    both have requests waiting. The default weight is 1.
+
+    \sa setRequestFlow()
+*/
+void QCurl::setFlowWeight(const QString &flow, int weight)
+{
+    if (weight <= 1)
+        d->flowWeights.remove(flow);
+    else
+        d->flowWeights.insert(flow, weight);
+}
+
+/*!
+    Returns the weight of the flow \a flow.
+
+    \sa setFlowWeight()
+*/
+int QCurl::flowWeight(const QString &flow) const
+{
+    return d->flowWeights.value(flow, 1);
+}
+
+/*!
+    Limits the rate at which response bodies are read by this object to
+    \a bytesPerSecond. A value of 0 (the default) removes the limit.
+
+    Data that may not be read yet is left in the socket. Its read buffer
+    is kept small while a limit is set, so that TCP flow control slows
+    the server down instead of the data piling up in memory.
+
+    The limit applies in addition to setGlobalDownloadRateLimit().
+
+    \sa downloadRateLimit() setUploadRateLimit() setRequestRateLimit()
+*/
+void QCurl::setDownloadRateLimit(qint64 bytesPerSecond)
+{
+    d->rateLimiter.setRate(QCurlRateLimiter::Download, qMax<qint64>(0, bytesPerSecond));
+    d->applyReadBufferSize();
+}
+
+/*!
+    Returns the download rate limit of this object in bytes per second,
+    or 0 if there is none.
+
+    \sa setDownloadRateLimit()
+*/
+qint64 QCurl::downloadRateLimit() const
+{
+    return d->rateLimiter.rate(QCurlRateLimiter::Download);
+}
+
+/*!
+    Limits the rate at which request bodies are sent by this object to
+    \a bytesPerSecond. A value of 0 (the default) removes the limit.
+
+    The limit applies in addition to setGlobalUploadRateLimit().
+
+    \sa uploadRateLimit() setDownloadRateLimit()
+*/
+void QCurl::setUploadRateLimit(qint64 bytesPerSecond)
+{
+    d->rateLimiter.setRate(QCurlRateLimiter::Upload, qMax<qint64>(0, bytesPerSecond));
+}
+
+/*!
+    Returns the upload rate limit of this object in bytes per second, or
+    0 if there is none.
+
+    \sa setUploadRateLimit()
+*/
+qint64 QCurl::uploadRateLimit() const
+{
+    return d->rateLimiter.rate(QCurlRateLimiter::Upload);
+}
+
+/*!
+    Limits the requests this object starts to the server \a hostName to
+    \a requestsPerSecond, evenly spaced. A request that would exceed the
+    limit is held back until it may start; the requestStarted() signal
+    is emitted at that time. A value of 0 removes the limit.
+
+    The limit applies in addition to setGlobalRequestRateLimit().
+
+    \sa requestRateLimit() setDownloadRateLimit()
+*/
+void QCurl::setRequestRateLimit(const QString &hostName, qreal requestsPerSecond)
+{
+    d->rateLimiter.setRequestRate(hostName, requestsPerSecond);
+}
+
+/*!
+    Returns the request rate limit of this object for the server \a
+    hostName, or 0 if there is none.
+
+    \sa setRequestRateLimit()
+*/
+qreal QCurl::requestRateLimit(const QString &hostName) const
+{
+    return d->rateLimiter.requestRate(hostName);
+}
+
+/*!
+    Limits the rate at which all QCurl objects together read response
+    bodies to \a bytesPerSecond. A value of 0 (the default) removes the
+    limit. This function is thread-safe.
+
+    The limit takes effect on the next request of every object.
+
+    \sa setDownloadRateLimit() globalDownloadRateLimit()
+*/
+void QCurl::setGlobalDownloadRateLimit(qint64 bytesPerSecond)
+{
+    globalRateLimiter()->setRate(QCurlRateLimiter::Download, qMax<qint64>(0, bytesPerSecond));
+}
+
+/*!
+    Returns the download rate limit shared by all QCurl objects in bytes
+    per second, or 0 if there is none.
+
+    \sa setGlobalDownloadRateLimit()
+*/
+qint64 QCurl::globalDownloadRateLimit()
+{
+    return globalRateLimiter()->rate(QCurlRateLimiter::Download);
+}
+
+/*!
+    Limits the rate at which all QCurl objects together send request
+    bodies to \a bytesPerSecond. A value of 0 (the default) removes the
+    limit. This function is thread-safe.
+
+    \sa setUploadRateLimit() globalUploadRateLimit()
+*/
+void QCurl::setGlobalUploadRateLimit(qint64 bytesPerSecond)
+{
+    globalRateLimiter()->setRate(QCurlRateLimiter::Upload, qMax<qint64>(0, bytesPerSecond));
+}
+
+/*!
+    Returns the upload rate limit shared by all QCurl objects in bytes
+    per second, or 0 if there is none.
+
+    \sa setGlobalUploadRateLimit()
+*/
+qint64 QCurl::globalUploadRateLimit()
+{
+    return globalRateLimiter()->rate(QCurlRateLimiter::Upload);
+}
+
+/*!
+    Limits the requests all QCurl objects together start to the server
+    \a hostName to \a requestsPerSecond. A value of 0 removes the limit.
+    This function is thread-safe.
+
+    \sa setRequestRateLimit() globalRequestRateLimit()
+*/
+void QCurl::setGlobalRequestRateLimit(const QString &hostName, qreal requestsPerSecond)
+{
+    globalRateLimiter()->setRequestRate(hostName, requestsPerSecond);
+}
+
+/*!
+    Returns the request rate limit shared by all QCurl objects for the
+    server \a hostName, or 0 if there is none.
+
+    \sa setGlobalRequestRateLimit()
+*/
+qreal QCurl::globalRequestRateLimit(const QString &hostName)
+{
+    return globalRateLimiter()->requestRate(hostName);
+}
+
+/*!
+    Limits the response data a request may buffer to \a size bytes. A
+    value of 0 (the default) removes the limit.
+
+    Without a destination device this is the data waiting to be fetched
+    with read() or readAll(); with one it is the data the device has
+    not written out yet (QIODevice::bytesToWrite()). When the limit is
+    reached QCurl stops reading from the socket, so that TCP flow
+    control slows the server down, and continues once read() or the
+    device's bytesWritten() signal made room again.
+
+    \sa readBufferSize() bytesAvailable() setDownloadRateLimit()
+*/
+void QCurl::setReadBufferSize(qint64 size)
+{
+    d->maxBufferSize = qMax<qint64>(0, size);
+    d->applyReadBufferSize();
+    if (d->readPaused)
+        d->resumeReading();
+}
+
+/*!
+    Returns the limit of buffered response data in bytes, or 0 if there
+    is none.
+
+    \sa setReadBufferSize()
+*/
+qint64 QCurl::readBufferSize() const
+{
+    return d->maxBufferSize;
+}
+
+/*!
+    Sets the socket option \a option to \a value for the connections of
+    this object; a negative value restores the system default. The option
+    is applied to the current connection right away and to every new one
+    as soon as it is established. On the current connection, restoring
+    the default clears the flags (LowDelayOption, QuickAckOption and
+    KeepAliveOption), while buffer sizes and keep-alive timings keep the
+    value set before until the next connection, as the system cannot
+    undo them.
+
+    \code
+    QCurl curl(QLatin1String("api.example.com"));
+    curl.setSocketOption(QCurl::LowDelayOption, 1);     // small requests
+    curl.setSocketOption(QCurl::KeepAliveOption, 1);
+    curl.setSocketOption(QCurl::KeepAliveIdleOption, 30);
+    \endcode
+
+    A QTcpSocket only has a descriptor once it connected, so buffer sizes
+    set for it are applied to an established connection (where the
+    receive window scale was already agreed on) and FastOpenOption has no
+    effect on it; QCurlEpollSocket sets all options before connecting,
+    and applies later changes to its connection as well.
+    The options are only supported on Unix.
+
+    \sa socketOption() SocketOption
+*/
+void QCurl::setSocketOption(SocketOption option, int value)
+{
+    if (uint(option) >= uint(QCurlSocketOptionCount)) {
+        qWarning("QCurl::setSocketOption: invalid socket option %d", int(option));
+        return;
+    }
+    d->socketOptions[option] = qMax(-1, value);
+    // transports with a socket of their own pick the change up from here
+    d->publishSocketOptions();
+    if (d->socket && d->socket->state() == QAbstractSocket::ConnectedState) {
+        int fd = int(d->socket->socketDescriptor());
+        d->socketOptionsPending = false;
+        if (value < 0)
+            qt_curl_resetSocketOption(fd, option);
+        qt_curl_applySocketOptions(fd, d->socketOptions, false);
+    }
+}
+
+/*!
+    Returns the value of the socket option \a option, or -1 if the system
+    default is used.
+
+    \sa setSocketOption()
+*/
+int QCurl::socketOption(SocketOption option) const
+{
+    if (uint(option) >= uint(QCurlSocketOptionCount))
+        return -1;
+    return d->socketOptions[option];
+}
+
+/*!
+    Coalesces the dataReadProgress(), dataSendProgress() and readyRead()
+    signals: they are emitted once at least \a bytes more bytes were
+    transferred or \a msecs milliseconds passed since the last ones,
+    whichever comes first. The first notification of a transfer and
+    the last one before a request finishes are never held back. A value
+    of 0 disables the respective condition; with both 0 (the default)
+    every read and write is reported.
+
+    On fast connections this saves most of the signal emissions, each
+    of which copies the response header for readyRead(). The signals
+    report the latest progress, and a single readyRead() may stand for
+    several reads. Awaiters set with setAwaiter() and sinks set with
+    setSink() are not affected.
+
+    \sa notificationBytes() notificationInterval()
+*/
+void QCurl::setNotificationInterval(qint64 bytes, int msecs)
+{
+    d->notifyBytes = qMax<qint64>(0, bytes);
+    d->notifyMsecs = qMax(0, msecs);
+    if (d->readHeld || d->readyReadHeld || d->sendHeld) {
+        // re-evaluate what is held back under the new settings
+        if (d->notificationDue(d->readDone, d->readNotified)
+            || d->notificationDue(d->sendDone, d->sendNotified))
+            d->_q_slotFlushNotifications();
+    }
+}
+
+/*!
+    Returns the number of bytes after which notifications are emitted,
+    or 0 if they are not coalesced by size.
+
+    \sa setNotificationInterval()
+*/
+qint64 QCurl::notificationBytes() const
+{
+    return d->notifyBytes;
+}
+
+/*!
+    Returns the time in milliseconds after which notifications are
+    emitted, or 0 if they are not coalesced by time.
+
+    \sa setNotificationInterval()
+*/
+int QCurl::notificationInterval() const
+{
+    return d->notifyMsecs;
+}
+
+int QCurlPrivate::addRequest(QCurlNormalRequest *req)
+{
+    QCurlRequestHeader h = req->requestHeader();
+    if (h.path().isEmpty()) {
+        // note: the following qWarning is autotested. If you change it, change the test too.
+        qWarning("QCurl: empty path requested is invalid -- using '/'");
+        h.setRequest(h.method(), QLatin1String("/"), h.majorVersion(), h.minorVersion());
+        req->setRequestHeader(h);
+    }
+
+    // contine below
+    return addRequest(static_cast<QCurlRequest *>(req));
+}
+
+int QCurlPrivate::addRequest(QCurlRequest *req)
+{
+    pending.append(req);
+    if (req->hasRequestHeader()) {
+        assignFinishTag(req);
+        reposition(pending.count() - 1);
+    }
+
+    if (pending.count() == 1) {
+        // don't emit the requestStarted() signal before the id is returned
+        invokeLater("_q_startNextRequest");
+    }
+    return req->id;
+}
+
+int QCurlPrivate::indexOf(int id) const
+{
+    for (int i = 0; i < pending.count(); ++i) {
+        if (pending.at(i)->id == id)
+            return i;
+    }
+    return -1;
+}
+
+void QCurlPrivate::assignFinishTag(QCurlRequest *r)
+{
+    qreal start = qMax(virtualTime, flowFinish.value(r->flow, 0));
+    r->finishTag = start + 1.0 / flowWeights.value(r->flow, 1);
+    flowFinish.insert(r->flow, r->finishTag);
+}
+
+static inline bool runsBefore(const QCurlRequest *a, const QCurlRequest *b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    if (a->finishTag != b->finishTag)
+        return a->finishTag < b->finishTag;
+    return a->id < b->id;
+}
+
+/*
+    Moves the HTTP request at \a index to its place in the schedule. The
+    head of the queue is the running request and stays put, and requests
+    never pass a setHost(), setUser(), close() or similar request, since
+    those change what the requests around them mean.
+*/
+void QCurlPrivate::reposition(int index)
+{
+    QCurlRequest *r = pending.at(index);
+    int to = index;
+    while (to > 1 && pending.at(to - 1)->hasRequestHeader() && runsBefore(r, pending.at(to - 1)))
+        --to;
+    if (to == index) {
+        while (to + 1 < pending.count() && pending.at(to + 1)->hasRequestHeader()
+               && runsBefore(pending.at(to + 1), r))
+            ++to;
+    }
+    if (to != index)
+        pending.move(index, to);
+}
+
+/*
+    Queues all of \a reqs, which have request headers, and puts them in
+    order with a single sort instead of repositioning each one.
+*/
+void QCurlPrivate::addRequests(const QVector<QCurlRequest *> &reqs)
+{
+    if (reqs.isEmpty())
+        return;
+    bool wasIdle = pending.isEmpty();
+
+    // the new requests can only move within the trailing run of HTTP
+    // requests, which is in order already
+    int from = pending.count();
+    while (from > 1 && pending.at(from - 1)->hasRequestHeader())
+        --from;
+    // an idle queue has no running head to keep in place
+    from = wasIdle ? 0 : qMax(from, 1);
+
+    pending.reserve(pending.count() + reqs.count());
+    for (int i = 0; i < reqs.count(); ++i) {
+        QCurlRequest *r = reqs.at(i);
+        pending.append(r);
+        assignFinishTag(r);
+    }
+    if (from < pending.count())
+        std::sort(pending.begin() + from, pending.end(), runsBefore);
+
+    if (wasIdle)
+        invokeLater("_q_startNextRequest");
+}
+
+void QCurlPrivate::_q_startNextRequest()
+{
+    Q_Q(QCurl);
+    if (pending.isEmpty())
+        return;
+    QCurlRequest *r = pending.first();
+    if (r->started)
+        return;
+    if (r->hasRequestHeader()) {
+        int msecs = requestDelay();
+        if (msecs > 0) {
+            // over the request rate of the host; try again when it allows
+            armTimer(requestPaceTimer, msecs);
+            return;
+        }
+    }
+
+    error = QCurl::NoError;
+    errorString = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Unknown error"));
+    // the progress of a request is reported from its first bytes on
+    readNotified = -1;
+    sendNotified = -1;
+    notifyClock.invalidate();
+
+    if (q->bytesAvailable() != 0)
+        q->readAll(); // clear the data
+    if (r->hasRequestHeader()) {
+        // self-clocked fair queuing: virtual time follows the request in service
+        virtualTime = qMax(virtualTime, r->finishTag);
+        QHash<QString, qreal>::Iterator it = flowFinish.begin();
+        while (it != flowFinish.end()) {
+            if (it.value() <= virtualTime)
+                it = flowFinish.erase(it);
+            else
+                ++it;
+        }
+    }
+    r->started = true;
+    int id = r->id;
+    if (!r->quiet) {
+        emit q->requestStarted(id);
+        // the slot may have cancelled the request
+        if (pending.isEmpty() || pending.first()->id != id)
+            return;
+    }
+    if (r->hasRequestHeader()) {
+        int msecs = timeoutValue(QCurl::TransferTimeout);
+        if (msecs > 0)
+            armTimer(transferTimer, msecs);
+    }
+    r->start(q);
+}
+
+void QCurlPrivate::_q_slotSendRequest()
+{
+    if (hostName.isNull()) {
+        finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "No server set to connect to")),
+                          QCurl::UnknownError);
+        return;
+    }
+
+    requestClock.start();
+    if (hedgingEnabled && !synchronous && !hedgeId && !pending.isEmpty() && pending.first()->hedgeable) {
+        int msecs = hedgeDelay();
+        if (msecs >= 0)
+            hedgeTimer.start(msecs);
+    }
+
+    QString connectionHost = hostName;
+    int connectionPort = port;
+    bool sslInUse = false;
+
+#ifndef QT_NO_OPENSSL
+    QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (mode == QCurl::ConnectionModeHttps || (sslSocket && sslSocket->isEncrypted()))
+        sslInUse = true;
+#endif
+
+#ifndef QT_NO_NETWORKPROXY
+    bool cachingProxyInUse = false;
+    bool transparentProxyInUse = false;
+    if (proxy.type() == QNetworkProxy::DefaultProxy)
+        proxy = QNetworkProxy::applicationProxy();
+
+    if (!localServer.isEmpty()) {
+        // local servers are never reached through a proxy
+    } else if (proxy.type() == QNetworkProxy::HttpCachingProxy) {
+        if (proxy.hostName().isEmpty())
+            proxy.setType(QNetworkProxy::NoProxy);
+        else
+            cachingProxyInUse = true;
+    } else if (proxy.type() == QNetworkProxy::HttpProxy) {
+        // Compatibility behaviour: HttpProxy can be used to mean both
+        // transparent and caching proxy
+        if (proxy.hostName().isEmpty()) {
+            proxy.setType(QNetworkProxy::NoProxy);
+        } else if (sslInUse) {
+            // Disallow use of caching proxy with HTTPS; instead fall back to
+            // transparent HTTP CONNECT proxying.
+            transparentProxyInUse = true;
+        } else {
+            proxy.setType(QNetworkProxy::HttpCachingProxy);
+            cachingProxyInUse = true;
+        }
+    }
+
+    // Proxy support. Insert the Proxy-Authorization item into the
+    // header before it's sent off to the proxy.
+    if (cachingProxyInUse) {
+        expandHeader();
+        QUrl proxyUrl;
+        proxyUrl.setScheme(QLatin1String("http"));
+        proxyUrl.setHost(hostName);
+        if (port && port != 80)
+            proxyUrl.setPort(port);
+        QString request = QString::fromLatin1(proxyUrl.resolved(QUrl::fromEncoded(header.path().toLatin1())).toEncoded());
+
+        header.setRequest(header.method(), request, header.majorVersion(), header.minorVersion());
+        header.setValue(QLatin1String("Proxy-Connection"), QLatin1String("keep-alive"));
+
+        QCurlAuthenticatorPrivate *auth = QCurlAuthenticatorPrivate::getPrivate(proxyAuthenticator);
+        if (auth && auth->method != QCurlAuthenticatorPrivate::None) {
+            QByteArray response = auth->calculateResponse(header.method().toLatin1(), header.path().toLatin1());
+            header.setValue(QLatin1String("Proxy-Authorization"), QString::fromLatin1(response));
+        }
+
+        connectionHost = proxy.hostName();
+        connectionPort = proxy.port();
+    }
+
+    if (transparentProxyInUse || sslInUse) {
+        socket->setProxy(proxy);
+    }
+#endif
+
+    // Username support. Insert the user and password into the query
+    // string.
+    QCurlAuthenticatorPrivate *auth = QCurlAuthenticatorPrivate::getPrivate(authenticator);
+    if (auth && auth->method != QCurlAuthenticatorPrivate::None) {
+        expandHeader();
+        QByteArray response = auth->calculateResponse(header.method().toLatin1(), header.path().toLatin1());
+        header.setValue(QLatin1String("Authorization"), QString::fromLatin1(response));
+    }
+
+    applyReadBufferSize();
+
+    // Do we need to setup a new connection or can we reuse an
+    // existing one?
+    idleTimer.stop();
+    if (socket->peerName() != connectionHost || socket->peerPort() != connectionPort
+        || socket->state() != QTcpSocket::ConnectedState
+#ifndef QT_NO_OPENSSL
+        || (sslSocket && sslSocket->isEncrypted() != (mode == QCurl::ConnectionModeHttps))
+#endif
+        || isConnectionStale()
+        ) {
+        socket->blockSignals(true);
+        socket->abort();
+        socket->blockSignals(false);
+
+        keepAliveTimeout = -1;
+        keepAliveMax = -1;
+        socketOptionsPending = true;
+        setState(QCurl::Connecting);
+        startPhase(QCurl::HostLookupTimeout);
+#ifndef QT_NO_OPENSSL
+        if (sslSocket && mode == QCurl::ConnectionModeHttps) {
+            sslSocket->connectToHostEncrypted(hostName, port);
+        } else
+#endif
+        {
+            socket->connectToHost(connectionHost, connectionPort);
+        }
+    } else {
+        _q_slotConnected();
+    }
+
+}
+
+void QCurlPrivate::finishedWithSuccess()
+{
+    Q_Q(QCurl);
+    if (pending.isEmpty())
+        return;
+    QCurlRequest *r = pending.first();
+
+    // did we recurse?
+    if (r->finished)
+        return;
+    r->finished = true;
+    hasFinishedWithError = false;
+    stopTimeouts();
+    cancelHedge();
+
+    if (!r->quiet)
+        emit q->requestFinished(r->id, false);
+    if (hasFinishedWithError) {
+        // we recursed and changed into an error. The finishedWithError function
+        // below has emitted the done(bool) signal and cleared the queue by now.
+        return;
+    }
+    notifyFinished(r, false);
+
+    pending.removeFirst();
+    delete r;
+
+    if (pending.isEmpty()) {
+        // requests that failed on their own still count for the queue
+        bool failed = queueHadError;
+        queueHadError = false;
+        emit q->done(failed);
+    } else {
+        _q_startNextRequest();
+    }
+}
+
+void QCurlPrivate::finishedWithError(const QString &detail, int errorCode)
+{
+    if (!draining && retryRequest(QCurl::Error(errorCode)))
+        return;
+
+    // a cancelled request never takes the rest of the queue with it
+    if (draining || errorPolicy == QCurl::ContinueOnError)
+        finishedRequestWithError(detail, errorCode);
+    else
+        finishedAllWithError(detail, errorCode);
+}
+
+void QCurlPrivate::finishedAllWithError(const QString &detail, int errorCode)
+{
+    Q_Q(QCurl);
+    if (pending.isEmpty())
+        return;
+    QCurlRequest *r = pending.first();
+    hasFinishedWithError = true;
+    draining = false;
+    stopTimeouts();
+    cancelHedge();
+    dropNotifications();
+
+    error = QCurl::Error(errorCode);
+    errorString = detail;
+
+    // did we recurse?
+    if (!r->finished) {
+        r->finished = true;
+        if (!r->quiet)
+            emit q->requestFinished(r->id, true);
+    }
+    if (!pending.isEmpty() && pending.first() == r)
+        notifyFinished(r, true);
+
+    while (!pending.isEmpty())
+        discardRequest(pending.takeFirst());
+    queueHadError = false;
+    emit q->done(hasFinishedWithError);
+}
+
+/*
+    Fails the current request only. Its connection is dropped, as its
+    state is unknown after a failure, unless \a keepConnection says it
+    is idle and reusable. The next request is started from the event
+    loop, so that callers may still clean up behind us.
+*/
+void QCurlPrivate::finishedRequestWithError(const QString &detail, int errorCode, bool keepConnection)
+{
+    Q_Q(QCurl);
+    if (pending.isEmpty())
+        return;
+    QCurlRequest *r = pending.first();
+    stopTimeouts();
+    cancelHedge();
+    dropNotifications();
+    if (!keepConnection)
+        resetConnection();
+
+    if (draining) {
+        // whatever ended the drain, the request was cancelled
+        draining = false;
+        error = QCurl::Aborted;
+        errorString = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted"));
+    } else {
+        error = QCurl::Error(errorCode);
+        errorString = detail;
+    }
+    queueHadError = true;
+
+    if (!r->finished) {
+        r->finished = true;
+        if (!r->quiet)
+            emit q->requestFinished(r->id, true);
+    }
+
+    // the slot may have aborted or cleared the queue under us
+    if (pending.isEmpty() || pending.first() != r)
+        return;
+    notifyFinished(r, true);
+    pending.removeFirst();
+    delete r;
+
+    if (pending.isEmpty()) {
+        queueHadError = false;
+        emit q->done(true);
+    } else {
+        invokeLater("_q_startNextRequest");
+    }
+}
+
+// Drops the connection without reporting anything for it.
+void QCurlPrivate::resetConnection()
+{
+    postDevice = 0;
+    pendingPost = false;
+    disarmTimer(post100ContinueTimer);
+    idleTimer.stop();
+    disarmTimer(readPaceTimer);
+    disarmTimer(writePaceTimer);
+    readPaused = false;
+    unwatchDevice();
+    dropNotifications();
+    if (socket) {
+        socket->blockSignals(true);
+        socket->abort();
+        socket->blockSignals(false);
+    }
+    if (state != QCurl::Unconnected)
+        setState(QCurl::Unconnected);
+}
+
+/*
+    Cancels the request at the head of the queue. A request that is
+    still waiting for its turn just goes away. A running one is failed
+    with Aborted, after reading the rest of its body if that is cheaper
+    than opening a new connection for the next request.
+*/
+bool QCurlPrivate::cancelCurrent()
+{
+    QCurlRequest *r = pending.first();
+    if (r->finished || draining)
+        return false;
+    if (!r->started) {
+        // _q_startNextRequest is already queued for it and starts the next one
+        discardRequest(pending.takeFirst());
+        return true;
+    }
+
+    const QString detail = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted"));
+    if (state == QCurl::Reading && !readHeader && !repost && chunkedSize == -1
+        && response.hasContentLength() && socket && socket->state() == QTcpSocket::ConnectedState
+        && response.value(QLatin1String("connection")).toLower() != QLatin1String("close")
+        && keepAliveMax != 0) {
+        qint64 left = qint64(response.contentLength()) - bytesDone - rba.size();
+        if (left > 0 && left <= QCurlMaxDrainSize) {
+#if defined(QCurl_DEBUG)
+            qDebug("QCurl: cancelling request %d, draining %lld bytes", r->id, left);
+#endif
+            cancelHedge();
+            retrying = false;
+            draining = true;
+            // what the application did not read yet is dropped as well
+            bytesDone += rba.size() + hedgeHeld.size();
+            rba.clear();
+            hedgeHeld.clear();
+            hedgeHolding = false;
+            if (readPaused)
+                resumeReading();
+            return true;
+        }
+    }
+
+    // nothing is in flight on an idle connection, so it stays usable
+    finishedRequestWithError(detail, QCurl::Aborted, state == QCurl::Connected);
+    return true;
+}
+
+// Nothing is reported to the batches of a dying object: their requests
+// are still counted down, but neither the callback nor batchFinished()
+// is called. The other awaiters are told once the object is gone.
+void QCurlPrivate::detachAwaiters()
+{
+    QCurlOrphanNotifier *notifier = 0;
+    while (!awaiterCalls.isEmpty()) {
+        QCurlAwaiterCall call = awaiterCalls.takeFirst();
+        if (!call.finished)
+            continue;
+        if (!notifier)
+            notifier = new QCurlOrphanNotifier;
+        notifier->adopt(call.awaiter, call.reply);
+    }
+    for (int i = 0; i < pending.count(); ++i) {
+        QCurlRequest *r = pending.at(i);
+        if (!r->awaiter)
+            continue;
+        if (r->quiet) {
+            static_cast<QCurlBatchAwaiter *>(r->awaiter)->batch->curl = 0;
+            continue;
+        }
+        if (!notifier)
+            notifier = new QCurlOrphanNotifier;
+        notifier->adopt(r->awaiter, QCurlReply(r->id, QCurl::Aborted,
+                                               QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted")),
+                                               QCurlResponseHeader(), QByteArray()));
+        r->awaiter = 0;
+    }
+    if (notifier)
+        QCoreApplication::postEvent(notifier, new QEvent(QEvent::User));
+}
+
+// Deletes a request that leaves the queue without having finished.
+void QCurlPrivate::discardRequest(QCurlRequest *r)
+{
+    if (QCurlSink *sink = r->sink) {
+        r->sink = 0;
+        sink->onComplete(QCurl::Aborted);
+    }
+    QCurlAwaiter *awaiter = r->awaiter;
+    bool wanted = awaiter != 0;
+#ifndef QT_NO_QFUTURE
+    wanted = wanted || futures.contains(r->id);
+#endif
+    if (wanted) {
+        QCurlReply reply(r->id, QCurl::Aborted, QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted")),
+                         QCurlResponseHeader(), QByteArray());
+#ifndef QT_NO_QFUTURE
+        QFutureInterface<QCurlReply> promise = futures.take(r->id);
+        if (promise.isStarted()) {
+            promise.reportResult(reply);
+            promise.reportFinished();
+        }
+#endif
+        int id = r->id;
+        bool quiet = r->quiet;
+        delete r;
+        if (!awaiter)
+            return;
+        // a batch only counts the request down
+        if (quiet)
+            awaiter->finished(reply);
+        else
+            callAwaiterLater(awaiter, id, true, reply);
+        return;
+    }
+    delete r;
+}
+
+/*
+    Hands the outcome of the current request \a r to its future and its
+    awaiter, if anybody asked for them, after requestFinished() was
+    emitted for it. The buffered body moves into the reply.
+*/
+void QCurlPrivate::notifyFinished(QCurlRequest *r, bool failed)
+{
+    if (QCurlSink *sink = r->sink) {
+        r->sink = 0;
+        sink->onComplete(failed ? error : QCurl::NoError);
+    }
+    QCurlAwaiter *awaiter = r->awaiter;
+    bool wanted = awaiter != 0;
+#ifndef QT_NO_QFUTURE
+    wanted = wanted || (!futures.isEmpty() && futures.contains(r->id));
+#endif
+    if (!wanted)
+        return;
+    r->awaiter = 0;
+
+    QCurlResponseHeader header = r->hasResponse ? response : QCurlResponseHeader();
+    QByteArray body;
+    if (!failed && !rba.isEmpty()) {
+        // a single block is handed over as is, without copying
+        body = rba.size() == rba.nextDataBlockSize() ? rba.read() : rba.readAll();
+        bytesDone += body.size();
+    }
+    QCurlReply reply = failed ? QCurlReply(r->id, error, errorString, header, body)
+                              : QCurlReply(r->id, QCurl::NoError, QString(), header, body);
+
+#ifndef QT_NO_QFUTURE
+    QFutureInterface<QCurlReply> promise = futures.take(r->id);
+    if (promise.isStarted()) {
+        promise.reportResult(reply);
+        promise.reportFinished();
+    }
+#endif
+    if (!awaiter)
+        return;
+    // a batch only counts the request down; anything else may resume a
+    // coroutine, which must not find us in the middle of finishing
+    if (r->quiet)
+        awaiter->finished(reply);
+    else
+        callAwaiterLater(awaiter, r->id, true, reply);
+}
+
+/*
+    Queues a call of \a awaiter for the request \a id: finished() with
+    \a reply if \a finished is true, readyRead() otherwise. The awaiter
+    may resume a coroutine that deletes this object or aborts its queue,
+    so the call is made once the current slot returned and we are done
+    with the request.
+*/
+void QCurlPrivate::callAwaiterLater(QCurlAwaiter *awaiter, int id, bool finished,
+                                    const QCurlReply &reply)
+{
+    if (!finished) {
+        // one readyRead() covers all the data buffered until it is made
+        for (int i = 0; i < awaiterCalls.count(); ++i) {
+            if (awaiterCalls.at(i).id == id && !awaiterCalls.at(i).finished)
+                return;
+        }
+    }
+    QCurlAwaiterCall call;
+    call.awaiter = awaiter;
+    call.id = id;
+    call.finished = finished;
+    call.reply = reply;
+    awaiterCalls.append(call);
+    if (awaiterCalls.count() == 1)
+        invokeLater("_q_callAwaiters");
+}
+
+void QCurlPrivate::_q_callAwaiters()
+{
+    Q_Q(QCurl);
+    QPointer<QCurl> guard(q);
+    while (!awaiterCalls.isEmpty()) {
+        QCurlAwaiterCall call = awaiterCalls.takeFirst();
+        if (call.finished) {
+            call.awaiter->finished(call.reply);
+        } else {
+            // once the request finished, its data went into the reply
+            if (pending.isEmpty() || pending.first()->id != call.id || rba.isEmpty())
+                continue;
+            call.awaiter->readyRead();
+        }
+        // the awaiter may have deleted us
+        if (!guard)
+            return;
+    }
+}
+
+int QCurlPrivate::timeoutValue(QCurl::Timeout type) const
+{
+    if (!pending.isEmpty() && pending.first()->timeouts[type] >= 0)
+        return pending.first()->timeouts[type];
+    return timeouts[type];
+}
+
+void QCurlPrivate::startPhase(QCurl::Timeout type)
+{
+    phase = type;
+    int msecs = timeoutValue(type);
+    if (msecs > 0)
+        armTimer(phaseTimer, msecs);
+    else
+        disarmTimer(phaseTimer);
+}
+
+void QCurlPrivate::stopTimeouts()
+{
+    disarmTimer(transferTimer);
+    disarmTimer(phaseTimer);
+    disarmTimer(retryTimer);
+}
+
+QCurlRetryPolicy *QCurlPrivate::currentRetryPolicy() const
+{
+    if (pending.isEmpty())
+        return 0;
+    QCurlRequest *r = pending.first();
+    return r->retryPolicySet ? r->retryPolicy : retryPolicy;
+}
+
+bool QCurlPrivate::canRetry() const
+{
+    if (pending.isEmpty())
+        return false;
+    QCurlRequest *r = pending.first();
+    if (r->finished || !r->hasRequestHeader())
+        return false;
+    // the body has to be sent again from the start
+    QIODevice *source = r->sourceDevice();
+    return !source || !source->isSequential();
+}
+
+/*
+    Called when the current request failed with \a err; returns true if
+    the retry policy wants another attempt, which is then scheduled.
+*/
+bool QCurlPrivate::retryRequest(QCurl::Error err)
+{
+    QCurlRetryPolicy *policy = currentRetryPolicy();
+    if (!policy || !canRetry())
+        return false;
+    // once the response header went out a retry would report it twice
+    if (state == QCurl::Reading && !readHeader)
+        return false;
+
+    QCurlRequest *r = pending.first();
+    QCurlResponseHeader noResponse;
+    if (!policy->shouldRetry(header, err, noResponse, r->attempts))
+        return false;
+    int msecs = policy->retryDelay(noResponse, r->attempts);
+    if (msecs < 0)
+        return false;
+
+#if defined(QCurl_DEBUG)
+    qDebug("QCurl: request %d failed with %d, retrying in %d ms", r->id, int(err), msecs);
+#endif
+    disarmTimer(phaseTimer);
+    resetConnection();
+    scheduleRetry(msecs);
+    return true;
+}
+
+/*
+    Called with a freshly parsed final response; returns true if its
+    status asks for a retry. The body is then dropped and the request
+    is sent again once it has been read.
+*/
+bool QCurlPrivate::retryResponse()
+{
+    QCurlRetryPolicy *policy = currentRetryPolicy();
+    if (!policy || !canRetry())
+        return false;
+
+    QCurlRequest *r = pending.first();
+    if (!policy->shouldRetry(header, QCurl::NoError, response, r->attempts))
+        return false;
+    retryDelayMsecs = policy->retryDelay(response, r->attempts);
+    return retryDelayMsecs >= 0;
+}
+
+void QCurlPrivate::scheduleRetry(int msecs)
+{
+    ++pending.first()->attempts;
+    armTimer(retryTimer, msecs);
+}
+
+void QCurlPrivate::recordLatency(int msecs)
+{
+    const int window = 64;
+    if (latencySamples.count() < window) {
+        latencySamples.append(msecs);
+    } else {
+        latencySamples[latencyIndex] = msecs;
+        latencyIndex = (latencyIndex + 1) % window;
+    }
+}
+
+// Returns the hedging delay, or -1 while there is too little history.
+int QCurlPrivate::hedgeDelay() const
+{
+    if (latencySamples.count() < 8)
+        return -1;
+    QList<int> sorted = latencySamples;
+    std::sort(sorted.begin(), sorted.end());
+    int index = qMin(sorted.count() - 1, sorted.count() * hedgingPercentile / 100);
+    return qMax(10, sorted.at(index));
+}
+
+void QCurlPrivate::cancelHedge()
+{
+    hedgeTimer.stop();
+    if (!hedgeId)
+        return;
+    // the duplicate lost; cancelling it drains a short rest of its
+    // response, so its connection can serve the next duplicate
+    int id = hedgeId;
+    hedgeId = 0;
+    hedgeCurl->cancel(id);
+}
+
+void QCurlPrivate::_q_slotHedge()
+{
+    Q_Q(QCurl);
+    if (pending.isEmpty() || hedgeId)
+        return;
+    QCurlRequest *r = pending.first();
+    if (r->finished || !r->hedgeable || (state == QCurl::Reading && !readHeader))
+        return;
+
+    if (!hedgeCurl) {
+        hedgeCurl = new QCurl(q);
+#ifndef QT_NO_NETWORKPROXY
+        hedgeCurl->setProxy(proxy);
+#endif
+        if (!authenticator.user().isEmpty())
+            hedgeCurl->setUser(authenticator.user(), authenticator.password());
+        QObject::connect(hedgeCurl, SIGNAL(requestFinished(int,bool)),
+                         q, SLOT(_q_slotHedgeFinished(int,bool)));
+    }
+    if (!localServer.isEmpty() && hedgeHost.isEmpty())
+        hedgeCurl->setLocalServer(localServer, hostName);
+    else if (hedgeHost.isEmpty())
+        hedgeCurl->setHost(hostName, mode, port);
+    else
+        hedgeCurl->setHost(hedgeHost, mode, hedgePort ? hedgePort : port);
+
+#if defined(QCurl_DEBUG)
+    qDebug("QCurl: hedging request %d after %lld ms", r->id, requestClock.elapsed());
+#endif
+    hedgeRequestId = r->id;
+    hedgeId = hedgeCurl->request(r->requestHeader());
+}
+
+void QCurlPrivate::_q_slotHedgeFinished(int id, bool error)
+{
     Q_Q(QCurl);
+    if (id != hedgeId)
+        return;
+    hedgeId = 0;
     if (pending.isEmpty())
         return;
     QCurlRequest *r = pending.first();
+    if (r->id != hedgeRequestId || r->finished)
+        return;
+    if (error) {
+        // the original is on its own again
+        if (hedgeHolding)
+            publishResponse();
+        return;
+    }
+
+    // The duplicate won. Abandon the original attempt, whose connection
+    // is still busy with its response, and report the duplicate's
+    // response as the response of the request.
+    QByteArray body = hedgeCurl->readAll();
+    resetConnection();
+    hedgeHolding = false;
+    hedgeHeld.clear();
+    response = hedgeCurl->lastResponse();
+    bytesDone = 0;
+    publishResponse();
+    if (pending.isEmpty() || pending.first() != r || !deliverBody(body))
+        return;
+    if (readHeld || readyReadHeld)
+        _q_slotFlushNotifications();
+    finishedWithSuccess();
+}
+
+// Reports the response header of the current request, followed by the
+// body that was held back while a duplicate raced it.
+void QCurlPrivate::publishResponse()
+{
+    Q_Q(QCurl);
+    hedgeHolding = false;
+    QCurlRequest *r = pending.isEmpty() ? 0 : pending.first();
+    if (r) {
+        r->hasResponse = true;
+        if (r->sink)
+            r->sink->onHeaders(response);
+    }
+    emit q->responseHeaderReceived(response);
+    QByteArray body;
+    body.swap(hedgeHeld);
+    if (r && !pending.isEmpty() && pending.first() == r)
+        deliverBody(body);
+}
+
+// Hands out body data that was not delivered as it arrived. Returns
+// false if the request failed on it.
+bool QCurlPrivate::deliverBody(const QByteArray &body)
+{
+    Q_Q(QCurl);
+    if (body.isEmpty() || pending.isEmpty())
+        return true;
+    QCurlRequest *r = pending.first();
+    qint64 total = response.hasContentLength() ? response.contentLength() : 0;
+    if (r->sink) {
+        bytesDone += body.size();
+        r->sink->onData(body.constData(), size_t(body.size()));
+        notifyReadProgress(bytesDone, total, false);
+    } else if (toDevice) {
+        if (toDevice->write(body) != body.size()) {
+            finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Error writing response to device")), QCurl::UnknownError);
+            return false;
+        }
+        bytesDone += body.size();
+        notifyReadProgress(bytesDone, total, false);
+    } else {
+        rba.append(body);
+        if (r->awaiter)
+            callAwaiterLater(r->awaiter, r->id, false);
+        notifyReadProgress(bytesDone + q->bytesAvailable(), total, !r->quiet);
+    }
+    return true;
+}
+
+qint64 QCurlPrivate::transferAllowance(QCurlRateLimiter::Direction dir, qint64 wanted)
+{
+    qint64 local = rateLimiter.allowance(dir, wanted);
+    qint64 global = globalRateLimiter()->allowance(dir, wanted);
+    if (local < 0)
+        return global;
+    return global < 0 ? local : qMin(local, global);
+}
+
+int QCurlPrivate::transferDelay(QCurlRateLimiter::Direction dir, qint64 wanted)
+{
+    return qMax(rateLimiter.msecsUntil(dir, wanted), globalRateLimiter()->msecsUntil(dir, wanted));
+}
+
+void QCurlPrivate::takeTransfer(QCurlRateLimiter::Direction dir, qint64 count)
+{
+    rateLimiter.take(dir, count);
+    globalRateLimiter()->take(dir, count);
+}
+
+// Returns 0 and counts the request if it may start now.
+int QCurlPrivate::requestDelay()
+{
+    int msecs = qMax(rateLimiter.msecsUntilRequest(hostName),
+                     globalRateLimiter()->msecsUntilRequest(hostName));
+    if (msecs == 0) {
+        rateLimiter.takeRequest(hostName);
+        globalRateLimiter()->takeRequest(hostName);
+    }
+    return msecs;
+}
+
+/*
+    A small socket read buffer under a download limit is what makes the
+    limit reach the server: once it is full Qt stops reading, the kernel
+    buffer fills up and TCP closes the receive window.
+*/
+void QCurlPrivate::applyReadBufferSize()
+{
+    if (!socket)
+        return;
+    qint64 local = rateLimiter.rate(QCurlRateLimiter::Download);
+    qint64 global = globalRateLimiter()->rate(QCurlRateLimiter::Download);
+    qint64 rate = local > 0 && global > 0 ? qMin(local, global) : qMax(local, global);
+    qint64 size = rate > 0 ? qMax<qint64>(16 * 1024, rate / 4) : 0;
+    if (maxBufferSize > 0) {
+        qint64 cap = qMax<qint64>(16 * 1024, maxBufferSize);
+        size = size > 0 ? qMin(size, cap) : cap;
+    }
+    socket->setReadBufferSize(size);
+}
+
+qint64 QCurlPrivate::bufferedBytes() const
+{
+    // a response held back for a hedge race counts as well
+    if (toDevice)
+        return qMax<qint64>(0, toDevice->bytesToWrite()) + hedgeHeld.size();
+    return rba.size() + hedgeHeld.size();
+}
+
+/*
+    The consumer is behind: stop reading until it caught up. The read
+    idle deadline is suspended meanwhile, as the server is not to blame.
+*/
+void QCurlPrivate::pauseReading()
+{
+    Q_Q(QCurl);
+    readPaused = true;
+    disarmTimer(phaseTimer);
+    if (toDevice && toDevice != watchedDevice) {
+        unwatchDevice();
+        watchedDevice = toDevice;
+        QObject::connect(watchedDevice, SIGNAL(bytesWritten(qint64)), q, SLOT(_q_slotDeviceBytesWritten()));
+    }
+}
+
+void QCurlPrivate::resumeReading()
+{
+    // leave some slack so we do not flip for every few bytes consumed
+    if (state == QCurl::Reading && !draining && maxBufferSize > 0
+        && bufferedBytes() > maxBufferSize / 2)
+        return;
+    readPaused = false;
+    unwatchDevice();
+    // not from within the consumer's slot
+    invokeLater("_q_slotPaceRead");
+}
+
+void QCurlPrivate::unwatchDevice()
+{
+    Q_Q(QCurl);
+    if (!watchedDevice)
+        return;
+    QObject::disconnect(watchedDevice, SIGNAL(bytesWritten(qint64)), q, SLOT(_q_slotDeviceBytesWritten()));
+    watchedDevice = 0;
+}
+
+// the value of the Host field for requests to the current server
+QString QCurlPrivate::hostField() const
+{
+    if (port && port != 80)
+        return hostName + QLatin1Char(':') + QString::number(port);
+    return hostName;
+}
+
+// hostField() as template requests send it, only encoded again when the server changes
+const QByteArray &QCurlPrivate::encodedHostField()
+{
+    if (encodedHost.isEmpty() || encodedHostName != hostName || encodedHostPort != port) {
+        encodedHostName = hostName;
+        encodedHostPort = port;
+        encodedHost = hostField().toLatin1();
+    }
+    return encodedHost;
+}
+
+/*
+    Replaces the pre-serialized header of a request made from a
+    QCurlRequestTemplate with the full QCurlRequestHeader, for the rare
+    cases (proxies, authentication) that need to modify it.
+*/
+void QCurlPrivate::expandHeader()
+{
+    if (serializedHeader.isEmpty() || pending.isEmpty())
+        return;
+    serializedHeader.resize(0);
+    header = pending.first()->requestHeader();
+    header.setValue(QLatin1String("Host"), hostField());
+    if (!buffer.isNull())
+        header.setContentLength(buffer.size());
+}
+
+/*
+    Calls \a member once the current slot returned. Within execute()
+    the call is kept for the blocking loop instead of being posted.
+*/
+void QCurlPrivate::invokeLater(const char *member)
+{
+    Q_Q(QCurl);
+    if (synchronous)
+        deferred.append(member);
+    else
+        QMetaObject::invokeMethod(q, member, Qt::QueuedConnection);
+}
+
+/*
+    Starts \a timer; within execute() only its deadline is noted and the
+    blocking loop fires it.
+*/
+void QCurlPrivate::armTimer(QTimer &timer, int msecs)
+{
+    if (synchronous)
+        syncTimers.insert(&timer, syncClock.elapsed() + msecs);
+    else
+        timer.start(msecs);
+}
 
-    error = QCurl::NoError;
-    errorString = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Unknown error"));
+void QCurlPrivate::disarmTimer(QTimer &timer)
+{
+    timer.stop();
+    syncTimers.remove(&timer);
+}
 
-    if (q->bytesAvailable() != 0)
-        q->readAll(); // clear the data
-    emit q->requestStarted(r->id);
-    r->start(q);
+bool QCurlPrivate::timerArmed(const QTimer &timer) const
+{
+    return timer.isActive() || syncTimers.contains(const_cast<QTimer *>(&timer));
 }
 
-void QCurlPrivate::_q_slotSendRequest()
+/*
+    The loop of execute(): runs the deferred calls and due timers, and
+    otherwise blocks on the socket, until \a awaiter has the reply or
+    \a msecs passed.
+*/
+void QCurlPrivate::runSynchronously(const QCurlSyncAwaiter *awaiter, int msecs)
 {
-    if (hostName.isNull()) {
-        finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "No server set to connect to")),
-                          QCurl::UnknownError);
-        return;
+    Q_Q(QCurl);
+    syncClock.start();
+    while (!awaiter->done) {
+        if (!deferred.isEmpty()) {
+            QMetaObject::invokeMethod(q, deferred.takeFirst(), Qt::DirectConnection);
+            continue;
+        }
+
+        qint64 now = syncClock.elapsed();
+        QTimer *next = 0;
+        qint64 due = -1;
+        QHash<QTimer *, qint64>::ConstIterator it = syncTimers.constBegin();
+        for (; it != syncTimers.constEnd(); ++it) {
+            if (!next || it.value() < due) {
+                next = it.key();
+                due = it.value();
+            }
+        }
+        if (next && due <= now) {
+            syncTimers.remove(next);
+            QMetaObject::invokeMethod(next, "timeout", Qt::DirectConnection);
+            continue;
+        }
+        if (msecs > 0 && now >= msecs) {
+            finishedRequestWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request timed out")),
+                                     QCurl::TimeoutError);
+            continue;
+        }
+
+        if (msecs > 0 && (due < 0 || due > msecs))
+            due = msecs;
+        if (!waitForSocket(due < 0 ? -1 : int(due - now))) {
+            // nothing left that could move the request forward
+            finishedRequestWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "HTTP request failed")),
+                                     QCurl::UnknownError);
+        }
     }
+    deferred.clear();
+    syncTimers.clear();
+}
 
-    QString connectionHost = hostName;
-    int connectionPort = port;
-    bool sslInUse = false;
+/*
+    Blocks for at most \a msecs (-1 for no limit) on what the connection
+    waits for in its current state; the socket emits its signals from
+    within the call. Returns false if there is nothing to wait for.
+*/
+bool QCurlPrivate::waitForSocket(int msecs)
+{
+    if (!socket || socket->state() == QAbstractSocket::UnconnectedState) {
+        if (msecs < 0)
+            return false;
+        QThread::msleep(msecs);
+        return true;
+    }
 
+    switch (state) {
+    case QCurl::HostLookup:
+    case QCurl::Connecting:
 #ifndef QT_NO_OPENSSL
-    QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
-    if (mode == QCurl::ConnectionModeHttps || (sslSocket && sslSocket->isEncrypted()))
-        sslInUse = true;
+        if (mode == QCurl::ConnectionModeHttps) {
+            if (QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket)) {
+                sslSocket->waitForEncrypted(msecs);
+                break;
+            }
+        }
 #endif
-
-#ifndef QT_NO_NETWORKPROXY
-    bool cachingProxyInUse = false;
-    bool transparentProxyInUse = false;
-    if (proxy.type() == QNetworkProxy::DefaultProxy)
-        proxy = QNetworkProxy::applicationProxy();
-
-    if (proxy.type() == QNetworkProxy::HttpCachingProxy) {
-        if (proxy.hostName().isEmpty())
-            proxy.setType(QNetworkProxy::NoProxy);
+        socket->waitForConnected(msecs);
+        break;
+    case QCurl::Sending:
+        if (socket->bytesToWrite() > 0)
+            socket->waitForBytesWritten(msecs);
         else
-            cachingProxyInUse = true;
-    } else if (proxy.type() == QNetworkProxy::HttpProxy) {
-        // Compatibility behaviour: HttpProxy can be used to mean both
-        // transparent and caching proxy
-        if (proxy.hostName().isEmpty()) {
-            proxy.setType(QNetworkProxy::NoProxy);
-        } else if (sslInUse) {
-            // Disallow use of caching proxy with HTTPS; instead fall back to
-            // transparent HTTP CONNECT proxying.
-            transparentProxyInUse = true;
-        } else {
-            proxy.setType(QNetworkProxy::HttpCachingProxy);
-            cachingProxyInUse = true;
-        }
+            socket->waitForReadyRead(msecs);
+        break;
+    case QCurl::Closing:
+        socket->waitForDisconnected(msecs);
+        break;
+    default:
+        socket->waitForReadyRead(msecs);
+        break;
     }
+    return true;
+}
 
-    // Proxy support. Insert the Proxy-Authorization item into the
-    // header before it's sent off to the proxy.
-    if (cachingProxyInUse) {
-        QUrl proxyUrl;
-        proxyUrl.setScheme(QLatin1String("http"));
-        proxyUrl.setHost(hostName);
-        if (port && port != 80)
-            proxyUrl.setPort(port);
-        QString request = QString::fromLatin1(proxyUrl.resolved(QUrl::fromEncoded(header.path().toLatin1())).toEncoded());
+bool QCurlPrivate::notificationDue(qint64 done, qint64 notified) const
+{
+    if (notifyBytes <= 0 && notifyMsecs <= 0)
+        return true;
+    // a new transfer always starts with a notification
+    if (notified < 0 || done < notified || (notifyBytes > 0 && done - notified >= notifyBytes))
+        return true;
+    return notifyMsecs > 0 && (!notifyClock.isValid() || notifyClock.elapsed() >= notifyMsecs);
+}
 
-        header.setRequest(header.method(), request, header.majorVersion(), header.minorVersion());
-        header.setValue(QLatin1String("Proxy-Connection"), QLatin1String("keep-alive"));
+void QCurlPrivate::notifyReadProgress(qint64 done, qint64 total, bool dataReady)
+{
+    readDone = done;
+    readTotal = total;
+    readHeld = true;
+    readyReadHeld = readyReadHeld || dataReady;
+    if (notificationDue(done, readNotified))
+        _q_slotFlushNotifications();
+    else if (notifyMsecs > 0 && !timerArmed(notifyTimer))
+        armTimer(notifyTimer, int(qMax<qint64>(0, notifyMsecs - notifyClock.elapsed())));
+}
 
-        QCurlAuthenticatorPrivate *auth = QCurlAuthenticatorPrivate::getPrivate(proxyAuthenticator);
-        if (auth && auth->method != QCurlAuthenticatorPrivate::None) {
-            QByteArray response = auth->calculateResponse(header.method().toLatin1(), header.path().toLatin1());
-            header.setValue(QLatin1String("Proxy-Authorization"), QString::fromLatin1(response));
-        }
+void QCurlPrivate::notifySendProgress(qint64 done, qint64 total)
+{
+    sendDone = done;
+    sendTotal = total;
+    sendHeld = true;
+    if (done >= total || notificationDue(done, sendNotified))
+        _q_slotFlushNotifications();
+    else if (notifyMsecs > 0 && !timerArmed(notifyTimer))
+        armTimer(notifyTimer, int(qMax<qint64>(0, notifyMsecs - notifyClock.elapsed())));
+}
 
-        connectionHost = proxy.hostName();
-        connectionPort = proxy.port();
+void QCurlPrivate::_q_slotFlushNotifications()
+{
+    Q_Q(QCurl);
+    disarmTimer(notifyTimer);
+    notifyClock.start();
+    if (sendHeld) {
+        sendHeld = false;
+        sendNotified = sendDone;
+        emit q->dataSendProgress(sendDone, sendTotal);
     }
-
-    if (transparentProxyInUse || sslInUse) {
-        socket->setProxy(proxy);
+    if (readHeld) {
+        readHeld = false;
+        readNotified = readDone;
+        emit q->dataReadProgress(readDone, readTotal);
     }
-#endif
-
-    // Username support. Insert the user and password into the query
-    // string.
-    QCurlAuthenticatorPrivate *auth = QCurlAuthenticatorPrivate::getPrivate(authenticator);
-    if (auth && auth->method != QCurlAuthenticatorPrivate::None) {
-        QByteArray response = auth->calculateResponse(header.method().toLatin1(), header.path().toLatin1());
-        header.setValue(QLatin1String("Authorization"), QString::fromLatin1(response));
+    if (readyReadHeld) {
+        readyReadHeld = false;
+        emit q->readyRead(response);
     }
+}
 
-    // Do we need to setup a new connection or can we reuse an
-    // existing one?
-    if (socket->peerName() != connectionHost || socket->peerPort() != connectionPort
-        || socket->state() != QTcpSocket::ConnectedState
-#ifndef QT_NO_OPENSSL
-        || (sslSocket && sslSocket->isEncrypted() != (mode == QCurl::ConnectionModeHttps))
-#endif
-        ) {
-        socket->blockSignals(true);
-        socket->abort();
-        socket->blockSignals(false);
-
-        setState(QCurl::Connecting);
-#ifndef QT_NO_OPENSSL
-        if (sslSocket && mode == QCurl::ConnectionModeHttps) {
-            sslSocket->connectToHostEncrypted(hostName, port);
-        } else
-#endif
-        {
-            socket->connectToHost(connectionHost, connectionPort);
-        }
-    } else {
-        _q_slotConnected();
-    }
+// what is held back for a transfer that failed is not reported
+void QCurlPrivate::dropNotifications()
+{
+    disarmTimer(notifyTimer);
+    readHeld = false;
+    readyReadHeld = false;
+    sendHeld = false;
+}
 
+void QCurlPrivate::_q_slotDeviceBytesWritten()
+{
+    if (readPaused)
+        resumeReading();
 }
 
-void QCurlPrivate::finishedWithSuccess()
+void QCurlPrivate::_q_slotPaceRead()
 {
-    Q_Q(QCurl);
-    if (pending.isEmpty())
-        return;
-    QCurlRequest *r = pending.first();
+    if (state == QCurl::Reading && socket && socket->bytesAvailable() > 0)
+        _q_slotReadyRead();
+}
 
-    // did we recurse?
-    if (r->finished)
-        return;
-    r->finished = true;
-    hasFinishedWithError = false;
+void QCurlPrivate::_q_slotPaceWrite()
+{
+    if (state == QCurl::Sending)
+        postMoreData();
+}
 
-    emit q->requestFinished(r->id, false);
-    if (hasFinishedWithError) {
-        // we recursed and changed into an error. The finishedWithError function
-        // below has emitted the done(bool) signal and cleared the queue by now.
+void QCurlPrivate::_q_slotRetry()
+{
+    Q_Q(QCurl);
+    if (pending.isEmpty() || pending.first()->finished)
         return;
-    }
+    pending.first()->start(q);
+}
 
-    pending.removeFirst();
-    delete r;
+void QCurlPrivate::_q_slotHostFound()
+{
+    if (phase == QCurl::HostLookupTimeout && state == QCurl::Connecting)
+        startPhase(QCurl::ConnectTimeout);
+}
 
-    if (pending.isEmpty()) {
-        emit q->done(false);
-    } else {
-        _q_startNextRequest();
-    }
+void QCurlPrivate::_q_slotEncrypted()
+{
+    if (phase == QCurl::EncryptionTimeout)
+        startPhase(QCurl::FirstByteTimeout);
 }
 
-void QCurlPrivate::finishedWithError(const QString &detail, int errorCode)
+void QCurlPrivate::_q_slotTransferTimeout()
 {
-    Q_Q(QCurl);
-    if (pending.isEmpty())
+    if (pending.isEmpty() || !pending.first()->hasRequestHeader())
         return;
-    QCurlRequest *r = pending.first();
-    hasFinishedWithError = true;
+    finishedRequestWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request timed out")),
+                             QCurl::TimeoutError);
+}
 
-    error = QCurl::Error(errorCode);
-    errorString = detail;
+void QCurlPrivate::_q_slotPhaseTimeout()
+{
+    if (pending.isEmpty() || !pending.first()->hasRequestHeader())
+        return;
+    if (retryRequest(QCurl::TimeoutError))
+        return;
 
-    // did we recurse?
-    if (!r->finished) {
-        r->finished = true;
-        emit q->requestFinished(r->id, true);
+    QString detail;
+    switch (phase) {
+    case QCurl::HostLookupTimeout:
+        detail = QString::fromLatin1(QT_TRANSLATE_NOOP("QCurl", "Host %1 lookup timed out")).arg(hostName);
+        break;
+    case QCurl::ConnectTimeout:
+        detail = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Connection timed out"));
+        break;
+    case QCurl::EncryptionTimeout:
+        detail = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "SSL handshake timed out"));
+        break;
+    case QCurl::FirstByteTimeout:
+        detail = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Server did not respond in time"));
+        break;
+    case QCurl::ReadIdleTimeout:
+        detail = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Timed out reading the response"));
+        break;
+    default:
+        detail = QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request timed out"));
+        break;
     }
-
-    while (!pending.isEmpty())
-        delete pending.takeFirst();
-    emit q->done(hasFinishedWithError);
+    finishedRequestWithError(detail, QCurl::TimeoutError);
 }
 
 void QCurlPrivate::_q_slotClosed()
 {
     Q_Q(QCurl);
 
+    if (timerArmed(retryTimer)) {
+        // the server dropped the connection we kept for the retry; the
+        // retry will simply open a new one
+        postDevice = 0;
+        setState(QCurl::Unconnected);
+        return;
+    }
+
     if (state == QCurl::Reading) {
         if (response.hasKey(QLatin1String("content-length"))) {
             // We got Content-Length, so did we get all bytes?
             if (bytesDone + q->bytesAvailable() != response.contentLength()) {
                 finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Wrong content length")), QCurl::WrongContentLength);
+                if (state == QCurl::Unconnected)
+                    return; // failed on its own, the connection is reset already
             }
         }
+        if (hedgeHolding && !pending.isEmpty() && !pending.first()->finished) {
+            // the close ended the response, which completed first
+            cancelHedge();
+            publishResponse();
+            if (state == QCurl::Unconnected)
+                return;
+        }
     } else if (state == QCurl::Connecting || state == QCurl::Sending) {
         finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Server closed connection unexpectedly")), QCurl::UnexpectedClose);
+        if (state == QCurl::Unconnected)
+            return;
     }
 
     postDevice = 0;
     if (state != QCurl::Closing)
         setState(QCurl::Closing);
-    QMetaObject::invokeMethod(q, "_q_slotDoFinished", Qt::QueuedConnection);
+    invokeLater("_q_slotDoFinished");
 }
 
 void QCurlPrivate::_q_continuePost()
@@ -2576,17 +5859,47 @@ void QCurlPrivate::_q_continuePost()
 
 void QCurlPrivate::_q_slotConnected()
 {
+    if (socketOptionsPending) {
+        socketOptionsPending = false;
+        qt_curl_applySocketOptions(int(socket->socketDescriptor()), socketOptions, false);
+    }
+
+#ifndef QT_NO_OPENSSL
+    QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
+    if (sslSocket && mode == QCurl::ConnectionModeHttps && !sslSocket->isEncrypted())
+        startPhase(QCurl::EncryptionTimeout);
+    else
+#endif
+        startPhase(QCurl::FirstByteTimeout);
+
     if (state != QCurl::Sending) {
         bytesDone = 0;
         setState(QCurl::Sending);
     }
 
-    QString str = header.toString();
-    bytesTotal = str.length();
-    socket->write(str.toLatin1(), bytesTotal);
+    if (!postDevice && !buffer.isEmpty()
+        && transferAllowance(QCurlRateLimiter::Upload, buffer.size()) >= 0) {
+        // an upload limit applies: send the body in paced pieces
+        uploadBuffer.close();
+        uploadBuffer.setData(buffer);
+        uploadBuffer.open(QIODevice::ReadOnly);
+        postDevice = &uploadBuffer;
+    }
+
+    if (!serializedHeader.isEmpty()) {
+        bytesTotal = serializedHeader.size();
+        socket->write(serializedHeader);
+#if defined(QCurl_DEBUG)
+        qDebug("QCurl: write request header:\n---{\n%s}---", serializedHeader.constData());
+#endif
+    } else {
+        QString str = header.toString();
+        bytesTotal = str.length();
+        socket->write(str.toLatin1(), bytesTotal);
 #if defined(QCurl_DEBUG)
-    qDebug("QCurl: write request header %p:\n---{\n%s}---", &header, str.toLatin1().constData());
+        qDebug("QCurl: write request header %p:\n---{\n%s}---", &header, str.toLatin1().constData());
 #endif
+    }
 
     if (postDevice) {
         postDevice->seek(0);    // reposition the device
@@ -2595,7 +5908,7 @@ void QCurlPrivate::_q_slotConnected()
         if (header.value(QLatin1String("expect")).contains(QLatin1String("100-continue"), Qt::CaseInsensitive)) {
             //create a time out for 2 secs.
             pendingPost = true;
-            post100ContinueTimer.start(2000);
+            armTimer(post100ContinueTimer, 2000);
         }
     } else {
         bytesTotal += buffer.size();
@@ -2605,7 +5918,6 @@ void QCurlPrivate::_q_slotConnected()
 
 void QCurlPrivate::_q_slotError(QAbstractSocket::SocketError err)
 {
-    Q_Q(QCurl);
     postDevice = 0;
 
     if (state == QCurl::Connecting || state == QCurl::Reading || state == QCurl::Sending) {
@@ -2624,7 +5936,7 @@ void QCurlPrivate::_q_slotError(QAbstractSocket::SocketError err)
                 socket->blockSignals(true);
                 socket->abort();
                 socket->blockSignals(false);
-                QMetaObject::invokeMethod(q, "_q_slotSendRequest", Qt::QueuedConnection);
+                invokeLater("_q_slotSendRequest");
                 return;
             }
             break;
@@ -2651,9 +5963,11 @@ void QCurlPrivate::_q_slotEncryptedBytesWritten(qint64 written)
 
 void QCurlPrivate::_q_slotBytesWritten(qint64 written)
 {
-    Q_Q(QCurl);
     bytesDone += written;
-    emit q->dataSendProgress(bytesDone, bytesTotal);
+    // upload progress keeps the first byte deadline away
+    if (phase == QCurl::FirstByteTimeout && state == QCurl::Sending)
+        startPhase(QCurl::FirstByteTimeout);
+    notifySendProgress(bytesDone, bytesTotal);
     postMoreData();
 }
 
@@ -2676,6 +5990,16 @@ void QCurlPrivate::postMoreData()
     if (socket->bytesToWrite() == 0) {
 #endif
         int max = qMin<qint64>(4096, postDevice->size() - postDevice->pos());
+        if (max > 0) {
+            qint64 allowed = transferAllowance(QCurlRateLimiter::Upload, max);
+            if (allowed == 0) {
+                if (!timerArmed(writePaceTimer))
+                    armTimer(writePaceTimer, transferDelay(QCurlRateLimiter::Upload, max));
+                return;
+            }
+            if (allowed > 0)
+                max = int(allowed);
+        }
         QByteArray arr;
         arr.resize(max);
 
@@ -2689,6 +6013,7 @@ void QCurlPrivate::postMoreData()
             postDevice = 0;
         }
 
+        takeTransfer(QCurlRateLimiter::Upload, n);
         socket->write(arr, n);
     }
 }
@@ -2696,6 +6021,10 @@ void QCurlPrivate::postMoreData()
 void QCurlPrivate::_q_slotReadyRead()
 {
     Q_Q(QCurl);
+    if (socketOptions[QCurl::QuickAckOption] > 0)
+        qt_curl_renewQuickAck(int(socket->socketDescriptor()));
+    if (!pending.isEmpty())
+        startPhase(QCurl::ReadIdleTimeout);
     QCurl::State oldState = state;
     if (state != QCurl::Reading) {
         setState(QCurl::Reading);
@@ -2704,6 +6033,9 @@ void QCurlPrivate::_q_slotReadyRead()
         bytesDone = 0;
         chunkedSize = -1;
         repost = false;
+        retrying = false;
+        hedgeHolding = false;
+        hedgeHeld.clear();
     }
 
     while (readHeader) {
@@ -2813,8 +6145,8 @@ void QCurlPrivate::_q_slotReadyRead()
 
         if (response.statusCode() == 100 && pendingPost) {
             // if we have pending POST, start sending data otherwise ignore
-            post100ContinueTimer.stop();
-            QMetaObject::invokeMethod(q, "_q_continuePost", Qt::QueuedConnection);
+            disarmTimer(post100ContinueTimer);
+            invokeLater("_q_continuePost");
             return;
         }
 
@@ -2822,15 +6154,27 @@ void QCurlPrivate::_q_slotReadyRead()
         // because when using the POST method, we send both the request header and data in
         // one chunk.
         if (response.statusCode() != 100) {
-            post100ContinueTimer.stop();
+            disarmTimer(post100ContinueTimer);
             pendingPost = false;
             readHeader = false;
             if (response.hasKey(QLatin1String("transfer-encoding")) &&
                 response.value(QLatin1String("transfer-encoding")).toLower().contains(QLatin1String("chunked")))
                 chunkedSize = 0;
 
+            parseKeepAlive();
+            if (!pending.isEmpty() && pending.first()->hedgeable)
+                recordLatency(int(requestClock.elapsed()));
+            hedgeTimer.stop();
             if (!repost)
-                emit q->responseHeaderReceived(response);
+                retrying = retryResponse();
+            if (!repost && !retrying) {
+                // with a duplicate running, the first complete response
+                // wins: this one is held back until it is complete
+                if (hedgeId)
+                    hedgeHolding = true;
+                else
+                    publishResponse();
+            }
             if (state == QCurl::Unconnected || state == QCurl::Closing)
                 return;
         } else {
@@ -2842,7 +6186,7 @@ void QCurlPrivate::_q_slotReadyRead()
 
     bool everythingRead = false;
 
-    if (q->currentRequest().method() == QLatin1String("HEAD") ||
+    if (header.method() == QLatin1String("HEAD") ||
         response.statusCode() == 304 || response.statusCode() == 204 ||
         response.statusCode() == 205) {
         // HEAD requests have only headers as replies
@@ -2853,7 +6197,21 @@ void QCurlPrivate::_q_slotReadyRead()
         everythingRead = true;
     } else {
         qint64 n = socket->bytesAvailable();
-        QByteArray *arr = 0;
+        // the body is read into the same buffer every time; reserving
+        // keeps its capacity when it is emptied
+        QByteArray &arr = readBuffer;
+        arr.reserve(int(qMin<qint64>(qMax<qint64>(n, arr.capacity()), QCurlMaxReadBuffer)));
+        arr.resize(0);
+        // bandwidth shaping and flow control: -1 means no limit; what we
+        // may not read now stays in the socket until the pace timer or the
+        // consumer brings us back
+        qint64 budget = n > 0 ? transferAllowance(QCurlRateLimiter::Download, n) : -1;
+        qint64 room = -1;
+        // execute() only hands out the body at the end, it cannot be capped
+        if (maxBufferSize > 0 && n > 0 && !retrying && !draining && !repost && !synchronous) {
+            room = qMax<qint64>(0, maxBufferSize - bufferedBytes());
+            budget = budget < 0 ? room : qMin(budget, room);
+        }
         if (chunkedSize != -1) {
             // transfer-encoding is chunked
             for (;;) {
@@ -2871,7 +6229,6 @@ void QCurlPrivate::_q_slotReadyRead()
                         finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Invalid HTTP chunked body")),
                                           QCurl::WrongContentLength);
                         closeConn();
-                        delete arr;
                         return;
                     }
                     if (chunkedSize == 0) // last-chunk
@@ -2894,6 +6251,11 @@ void QCurlPrivate::_q_slotReadyRead()
                 n = socket->bytesAvailable();
                 if (n == 0)
                     break;
+                if (budget >= 0) {
+                    n = qMin(n, budget - arr.size());
+                    if (n <= 0)
+                        break;
+                }
                 if (n == chunkedSize || n == chunkedSize+1) {
                     n = chunkedSize - 1;
                     if (n == 0)
@@ -2902,12 +6264,10 @@ void QCurlPrivate::_q_slotReadyRead()
 
                 // read data
                 qint64 toRead = chunkedSize < 0 ? n : qMin(n, chunkedSize);
-                if (!arr)
-                    arr = new QByteArray;
-                uint oldArrSize = arr->size();
-                arr->resize(oldArrSize + toRead);
-                qint64 read = socket->read(arr->data()+oldArrSize, toRead);
-                arr->resize(oldArrSize + read);
+                int oldArrSize = arr.size();
+                arr.resize(oldArrSize + toRead);
+                qint64 read = socket->read(arr.data() + oldArrSize, toRead);
+                arr.resize(oldArrSize + qMax<qint64>(read, 0));
 
                 chunkedSize -= read;
 
@@ -2919,7 +6279,6 @@ void QCurlPrivate::_q_slotReadyRead()
                         finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Invalid HTTP chunked body")),
                                           QCurl::WrongContentLength);
                         closeConn();
-                        delete arr;
                         return;
                     }
                 }
@@ -2931,81 +6290,244 @@ void QCurlPrivate::_q_slotReadyRead()
                 return;
             }
             n = qMin(qint64(response.contentLength() - bytesDone), n);
+            if (budget >= 0)
+                n = qMin(n, budget);
             if (n > 0) {
-                arr = new QByteArray;
-                arr->resize(n);
-                qint64 read = socket->read(arr->data(), n);
-                arr->resize(read);
+                arr.resize(n);
+                qint64 read = socket->read(arr.data(), n);
+                arr.resize(qMax<qint64>(read, 0));
             }
-            if (bytesDone + q->bytesAvailable() + n == response.contentLength())
+            if (bytesDone + q->bytesAvailable() + hedgeHeld.size() + n == response.contentLength())
                 everythingRead = true;
-        } else if (n > 0) {
-            // workaround for VC++ bug
-            QByteArray temp = socket->readAll();
-            arr = new QByteArray(temp);
+        } else if (n > 0 && budget != 0) {
+            if (budget > 0)
+                n = qMin(n, budget);
+            arr.resize(n);
+            qint64 read = socket->read(arr.data(), n);
+            arr.resize(qMax<qint64>(read, 0));
         }
 
-        if (arr && !repost) {
-            n = arr->size();
+        if (budget >= 0) {
+            qint64 got = arr.size();
+            takeTransfer(QCurlRateLimiter::Download, got);
+            qint64 left = socket->bytesAvailable();
+            if (!everythingRead && got >= budget && left > 0) {
+                if (room >= 0 && got >= room)
+                    pauseReading();
+                else if (!timerArmed(readPaceTimer))
+                    armTimer(readPaceTimer, transferDelay(QCurlRateLimiter::Download, left));
+            }
+        }
+
+        QCurlSink *sink = pending.isEmpty() ? 0 : pending.first()->sink;
+        if (arr.isEmpty() || repost) {
+            // nothing to hand out
+        } else if (retrying || draining) {
+            // the body of a response we retry or that was cancelled is dropped
+            bytesDone += arr.size();
+        } else if (hedgeHolding) {
+            hedgeHeld.append(arr);
+        } else if (sink) {
+            bytesDone += arr.size();
+            sink->onData(arr.constData(), size_t(arr.size()));
+            notifyReadProgress(bytesDone, response.hasContentLength() ? response.contentLength() : 0, false);
+        } else {
+            n = arr.size();
             if (toDevice) {
                 qint64 bytesWritten;
-                bytesWritten = toDevice->write(*arr, n);
-                delete arr;
-                arr = 0;
+                bytesWritten = toDevice->write(arr.constData(), n);
                 // if writing to the device does not succeed, quit with error
                 if (bytesWritten == -1 || bytesWritten < n) {
                     finishedWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Error writing response to device")), QCurl::UnknownError);
+                    if (state == QCurl::Unconnected)
+                        return;
                 } else {
                     bytesDone += bytesWritten;
 #if defined(QCurl_DEBUG)
                 qDebug("QCurl::_q_slotReadyRead(): read %lld bytes (%lld bytes done)", n, bytesDone);
 #endif
                 }
-                if (response.hasContentLength())
-                    emit q->dataReadProgress(bytesDone, response.contentLength());
-                else
-                    emit q->dataReadProgress(bytesDone, 0);
+                notifyReadProgress(bytesDone, response.hasContentLength() ? response.contentLength() : 0, false);
             } else {
-                char *ptr = rba.reserve(arr->size());
-                memcpy(ptr, arr->data(), arr->size());
-                delete arr;
-                arr = 0;
+                char *ptr = rba.reserve(arr.size());
+                memcpy(ptr, arr.constData(), arr.size());
 #if defined(QCurl_DEBUG)
                 qDebug("QCurl::_q_slotReadyRead(): read %lld bytes (%lld bytes done)", n, bytesDone + q->bytesAvailable());
 #endif
-                if (response.hasContentLength())
-                    emit q->dataReadProgress(bytesDone + q->bytesAvailable(), response.contentLength());
-                else
-                    emit q->dataReadProgress(bytesDone + q->bytesAvailable(), 0);
-                emit q->readyRead(response);
+                QCurlRequest *r = pending.isEmpty() ? 0 : pending.first();
+                if (r && r->awaiter)
+                    callAwaiterLater(r->awaiter, r->id, false);
+                notifyReadProgress(bytesDone + q->bytesAvailable(),
+                                   response.hasContentLength() ? response.contentLength() : 0,
+                                   !r || !r->quiet);
             }
         }
 
-        delete arr;
+        // do not hold on to what one huge read needed
+        if (readBuffer.capacity() > QCurlMaxReadBuffer)
+            readBuffer = QByteArray();
     }
 
     if (everythingRead) {
+        disarmTimer(phaseTimer);
+        if (hedgeHolding) {
+            // the original completed first; the duplicate lost
+            cancelHedge();
+            publishResponse();
+            if (state == QCurl::Unconnected || state == QCurl::Closing)
+                return;
+        }
+        // whatever was held back goes out before the request finishes
+        if (readHeld || readyReadHeld)
+            _q_slotFlushNotifications();
+        if (draining) {
+            if (response.value(QLatin1String("connection")).toLower() == QLatin1String("close")
+                || keepAliveMax == 0) {
+                resetConnection();
+            } else {
+                setState(QCurl::Connected);
+                startIdleTimer();
+            }
+            finishedRequestWithError(QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted")),
+                                     QCurl::Aborted, true);
+            return;
+        }
+        if (retrying) {
+            retrying = false;
+            if (response.value(QLatin1String("connection")).toLower() == QLatin1String("close")
+                || keepAliveMax == 0) {
+                resetConnection();
+            } else {
+                setState(QCurl::Connected);
+                startIdleTimer();
+            }
+            scheduleRetry(retryDelayMsecs);
+            return;
+        }
         if (repost) {
             _q_slotSendRequest();
             return;
         }
-        // Handle "Connection: close"
-        if (response.value(QLatin1String("connection")).toLower() == QLatin1String("close")) {
+        // Handle "Connection: close", and close proactively once the server
+        // told us through "Keep-Alive: max=" that it will not take more requests
+        if (response.value(QLatin1String("connection")).toLower() == QLatin1String("close")
+            || keepAliveMax == 0) {
             closeConn();
         } else {
             setState(QCurl::Connected);
+            startIdleTimer();
             // Start a timer, so that we emit the keep alive signal
             // "after" this method returned.
-            QMetaObject::invokeMethod(q, "_q_slotDoFinished", Qt::QueuedConnection);
+            invokeLater("_q_slotDoFinished");
         }
     }
 }
 
+/*
+    Picks up the "Keep-Alive: timeout=N, max=M" hint of the response, so
+    that an idle connection is dropped before the server closes it.
+*/
+void QCurlPrivate::parseKeepAlive()
+{
+    QString hint = response.value(QLatin1String("keep-alive"));
+    if (hint.isEmpty())
+        return;
+
+    QStringList params = hint.split(QLatin1Char(','), QString::SkipEmptyParts);
+    for (int i = 0; i < params.count(); ++i) {
+        QString param = params.at(i).trimmed();
+        int eq = param.indexOf(QLatin1Char('='));
+        if (eq == -1)
+            continue;
+        QString key = param.left(eq).trimmed().toLower();
+        bool ok;
+        int value = param.mid(eq + 1).trimmed().toInt(&ok);
+        if (!ok || value < 0)
+            continue;
+        if (key == QLatin1String("timeout"))
+            keepAliveTimeout = value * 1000;
+        else if (key == QLatin1String("max"))
+            keepAliveMax = value;
+    }
+}
+
+void QCurlPrivate::startIdleTimer()
+{
+    idleLimit = -1;
+    if (keepAliveTimeout >= 0) {
+        // leave a second of slack (or half the timeout for very short
+        // ones) so we never race the server's own close
+        idleLimit = qMax(keepAliveTimeout - 1000, keepAliveTimeout / 2);
+    }
+    if (idleTimeout > 0 && (idleLimit < 0 || idleTimeout < idleLimit))
+        idleLimit = idleTimeout;
+
+    idleClock.start();
+    // without an event loop isConnectionStale() does the job on its own
+    if (idleLimit >= 0 && !synchronous)
+        idleTimer.start(idleLimit);
+}
+
+void QCurlPrivate::_q_slotIdleTimeout()
+{
+    if (state != QCurl::Connected || !socket)
+        return;
+
+#if defined(QCurl_DEBUG)
+    qDebug("QCurl: closing connection idle for %d ms", idleLimit);
+#endif
+    // close quietly: there is no request in flight to report to
+    socket->blockSignals(true);
+    socket->close();
+    socket->blockSignals(false);
+    setState(QCurl::Closing);
+    setState(QCurl::Unconnected);
+}
+
+/*
+    Returns true if the idle connection we are about to reuse is likely
+    dead: its idle limit has passed, the server sent something while we
+    were not asking (usually a 408 right before closing) or the peer has
+    already shut down its side.
+*/
+bool QCurlPrivate::isConnectionStale()
+{
+    if (idleLimit >= 0 && idleClock.isValid() && idleClock.elapsed() >= idleLimit)
+        return true;
+    if (socket->bytesAvailable() > 0)
+        return true;
+
+#ifdef Q_OS_UNIX
+    qintptr fd = socket->socketDescriptor();
+    if (fd != -1) {
+        char c;
+        ssize_t n = ::recv(int(fd), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0)
+            return true;        // orderly shutdown from the peer
+        bool encrypted = false;
+#ifndef QT_NO_OPENSSL
+        QSslSocket *sslSocket = qobject_cast<QSslSocket *>(socket);
+        encrypted = sslSocket && sslSocket->isEncrypted();
+#endif
+        // TLS may legitimately deliver records (session tickets) while idle
+        if (n > 0 && !encrypted)
+            return true;
+    }
+#endif
+    return false;
+}
+
 void QCurlPrivate::_q_slotDoFinished()
 {
+    // Only act on the states this call is scheduled from; once a request
+    // failed on its own or was cancelled the next one may already be
+    // connecting, or not started at all, and a stale call must not
+    // finish it.
+    if (pending.isEmpty() || !pending.first()->started)
+        return;
     if (state == QCurl::Connected) {
         finishedWithSuccess();
-    } else if (state != QCurl::Unconnected) {
+    } else if (state == QCurl::Closing) {
         setState(QCurl::Unconnected);
         finishedWithSuccess();
     }
@@ -3058,7 +6580,6 @@ void QCurlPrivate::setState(int s)
 
 void QCurlPrivate::closeConn()
 {
-    Q_Q(QCurl);
     // If no connection is open -> ignore
     if (state == QCurl::Closing || state == QCurl::Unconnected)
         return;
@@ -3068,7 +6589,7 @@ void QCurlPrivate::closeConn()
 
     // Already closed ?
     if (!socket || !socket->isOpen()) {
-        QMetaObject::invokeMethod(q, "_q_slotDoFinished", Qt::QueuedConnection);
+        invokeLater("_q_slotDoFinished");
     } else {
         // Close now.
         socket->close();
@@ -3089,6 +6610,11 @@ void QCurlPrivate::setSock(QTcpSocket *sock)
     deleteSocket = (sock == 0);
     socket = sock;
     if (!socket) {
+#ifdef Q_OS_UNIX
+        if (!localServer.isEmpty())
+            socket = new QCurlLocalSocket(localServer);
+        else
+#endif
 #ifndef QT_NO_OPENSSL
         if (QSslSocket::supportsSsl())
             socket = new QSslSocket();
@@ -3098,6 +6624,7 @@ void QCurlPrivate::setSock(QTcpSocket *sock)
     }
 
     // connect all signals
+    QObject::connect(socket, SIGNAL(hostFound()), q, SLOT(_q_slotHostFound()));
     QObject::connect(socket, SIGNAL(connected()), q, SLOT(_q_slotConnected()));
     QObject::connect(socket, SIGNAL(disconnected()), q, SLOT(_q_slotClosed()));
     QObject::connect(socket, SIGNAL(readyRead()), q, SLOT(_q_slotReadyRead()));
@@ -3115,7 +6642,26 @@ void QCurlPrivate::setSock(QTcpSocket *sock)
                          q, SIGNAL(sslErrors(QList<QSslError>)));
         QObject::connect(socket, SIGNAL(encryptedBytesWritten(qint64)),
                          q, SLOT(_q_slotEncryptedBytesWritten(qint64)));
+        QObject::connect(socket, SIGNAL(encrypted()), q, SLOT(_q_slotEncrypted()));
     }
+
+    publishSocketOptions();
+}
+
+/*
+    Hands the socket options to the socket, for the transports that set
+    them on a socket of their own before connecting, and has them applied
+    to the connection of a QTcpSocket once it is established.
+*/
+void QCurlPrivate::publishSocketOptions()
+{
+    socketOptionsPending = true;
+    if (!socket)
+        return;
+    QVariantList options;
+    for (int i = 0; i < QCurlSocketOptionCount; ++i)
+        options.append(socketOptions[i]);
+    socket->setProperty(QCURL_SOCKET_OPTIONS_PROPERTY, options);
 }
 
 /*!
@@ -3136,6 +6682,465 @@ void QCurl::ignoreSslErrors()
 }
 #endif
 
+class QCurlRetryPolicyPrivate
+{
+public:
+    int maximumAttempts;
+    int initialDelay;
+    int maximumDelay;
+    QList<QCurl::Error> errors;
+    QList<int> statusCodes;
+    bool retryNonIdempotent;
+};
+
+/****************************************************
+ *
+ * QCurlRetryPolicy
+ *
+ ****************************************************/
+
+/*!
+    \class QCurlRetryPolicy
+    \brief The QCurlRetryPolicy class decides whether and when a failed
+    QCurl request is sent again.
+
+    \inmodule QtNetwork
+
+    A policy is installed with QCurl::setRetryPolicy() or, for a single
+    request, QCurl::setRequestRetryPolicy(). By default it retries
+    connection failures (ConnectionRefused, UnexpectedClose and
+    TimeoutError) and the status codes 429, 502, 503 and 504, up to three
+    attempts in total, and only for idempotent methods (GET, HEAD, PUT,
+    DELETE, OPTIONS and TRACE).
+
+    The delay between attempts grows exponentially from initialDelay()
+    up to maximumDelay() and is randomized ("jittered") so that many
+    clients failing together do not come back together. A \c Retry-After
+    header in the response is honoured; if it asks for more than
+    maximumDelay() the request is not retried.
+
+    Subclasses can reimplement shouldRetry() and retryDelay() for other
+    rules.
+*/
+
+/*!
+    Constructs a retry policy with the default settings.
+*/
+QCurlRetryPolicy::QCurlRetryPolicy()
+    : d(new QCurlRetryPolicyPrivate)
+{
+    d->maximumAttempts = 3;
+    d->initialDelay = 100;
+    d->maximumDelay = 10000;
+    d->errors << QCurl::ConnectionRefused << QCurl::UnexpectedClose << QCurl::TimeoutError;
+    d->statusCodes << 429 << 502 << 503 << 504;
+    d->retryNonIdempotent = false;
+}
+
+/*!
+    Destroys the retry policy.
+*/
+QCurlRetryPolicy::~QCurlRetryPolicy()
+{
+}
+
+/*!
+    Sets the total number of attempts made for a request, the first one
+    included, to \a attempts.
+*/
+void QCurlRetryPolicy::setMaximumAttempts(int attempts)
+{
+    d->maximumAttempts = qMax(1, attempts);
+}
+
+/*!
+    Returns the total number of attempts made for a request.
+*/
+int QCurlRetryPolicy::maximumAttempts() const
+{
+    return d->maximumAttempts;
+}
+
+/*!
+    Sets the delay before the first retry to \a initialDelay and the
+    upper bound of the exponential backoff to \a maximumDelay, both in
+    milliseconds.
+*/
+void QCurlRetryPolicy::setBackoff(int initialDelay, int maximumDelay)
+{
+    d->initialDelay = qMax(0, initialDelay);
+    d->maximumDelay = qMax(d->initialDelay, maximumDelay);
+}
+
+/*!
+    Returns the delay before the first retry in milliseconds.
+*/
+int QCurlRetryPolicy::initialDelay() const
+{
+    return d->initialDelay;
+}
+
+/*!
+    Returns the upper bound of the backoff in milliseconds.
+*/
+int QCurlRetryPolicy::maximumDelay() const
+{
+    return d->maximumDelay;
+}
+
+/*!
+    Sets the errors after which a request is retried to \a errors.
+*/
+void QCurlRetryPolicy::setRetryableErrors(const QList<QCurl::Error> &errors)
+{
+    d->errors = errors;
+}
+
+/*!
+    Returns the errors after which a request is retried.
+*/
+QList<QCurl::Error> QCurlRetryPolicy::retryableErrors() const
+{
+    return d->errors;
+}
+
+/*!
+    Sets the HTTP status codes for which a request is retried to \a codes.
+*/
+void QCurlRetryPolicy::setRetryableStatusCodes(const QList<int> &codes)
+{
+    d->statusCodes = codes;
+}
+
+/*!
+    Returns the HTTP status codes for which a request is retried.
+*/
+QList<int> QCurlRetryPolicy::retryableStatusCodes() const
+{
+    return d->statusCodes;
+}
+
+/*!
+    If \a enable is true, requests with non-idempotent methods such as
+    POST are retried as well. Only enable this if the server can cope
+    with receiving the same request twice.
+*/
+void QCurlRetryPolicy::setRetryNonIdempotent(bool enable)
+{
+    d->retryNonIdempotent = enable;
+}
+
+/*!
+    Returns true if non-idempotent requests are retried.
+*/
+bool QCurlRetryPolicy::retryNonIdempotent() const
+{
+    return d->retryNonIdempotent;
+}
+
+/*!
+    Returns true if \a request should be sent again after attempt number
+    \a attempt (starting at 1) failed. \a error is the error of the
+    attempt, or QCurl::NoError if the server answered with \a response.
+*/
+bool QCurlRetryPolicy::shouldRetry(const QCurlRequestHeader &request, QCurl::Error error,
+                                   const QCurlResponseHeader &response, int attempt) const
+{
+    if (attempt >= d->maximumAttempts)
+        return false;
+
+    if (!d->retryNonIdempotent) {
+        QString method = request.method().toUpper();
+        if (method != QLatin1String("GET") && method != QLatin1String("HEAD")
+            && method != QLatin1String("PUT") && method != QLatin1String("DELETE")
+            && method != QLatin1String("OPTIONS") && method != QLatin1String("TRACE"))
+            return false;
+    }
+
+    if (error != QCurl::NoError)
+        return d->errors.contains(error);
+    return response.isValid() && d->statusCodes.contains(response.statusCode());
+}
+
+/*!
+    Returns the delay in milliseconds before attempt \a attempt + 1, or -1
+    if the request should not be retried after all. \a response is the
+    response that triggered the retry; it is invalid if the attempt
+    failed with an error.
+*/
+int QCurlRetryPolicy::retryDelay(const QCurlResponseHeader &response, int attempt) const
+{
+    qint64 backoff = d->initialDelay;
+    for (int i = 1; i < attempt && backoff < d->maximumDelay; ++i)
+        backoff *= 2;
+    backoff = qMin<qint64>(backoff, d->maximumDelay);
+
+    // keep half of the backoff, randomize the other half
+    int half = int(backoff / 2);
+    int jitter = 0;
+    if (half > 0) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        jitter = int(QRandomGenerator::global()->bounded(half + 1));
+#else
+        jitter = qrand() % (half + 1);
+#endif
+    }
+    int msecs = int(backoff) - half + jitter;
+
+    QString retryAfter = response.isValid() ? response.value(QLatin1String("retry-after")).trimmed() : QString();
+    if (!retryAfter.isEmpty()) {
+        bool ok;
+        qint64 wait = retryAfter.toLongLong(&ok);
+        if (ok) {
+            wait *= 1000;
+        } else {
+            QDateTime date = QDateTime::fromString(retryAfter, Qt::RFC2822Date);
+            wait = date.isValid() ? QDateTime::currentDateTimeUtc().msecsTo(date) : -1;
+        }
+        if (wait > d->maximumDelay)
+            return -1;
+        if (wait > msecs)
+            msecs = int(wait);
+    }
+    return msecs;
+}
+
+/****************************************************
+ *
+ * QCurlAwaiter
+ *
+ ****************************************************/
+
+/*!
+    \class QCurlAwaiter
+    \brief The QCurlAwaiter class is told directly about the progress of
+    a QCurl request.
+
+    \inmodule QtNetwork
+
+    An awaiter is attached to a request with QCurl::setAwaiter(). Unlike
+    the signals of QCurl its functions are called directly, right after
+    the network event, which is what the coroutine types in qcurlcoro.h
+    build on.
+
+    The functions are called once the QCurl object is done with the
+    request. They may call into it, for instance to read data or to
+    schedule more requests, and may also delete it.
+*/
+
+/*!
+    Destroys the awaiter.
+*/
+QCurlAwaiter::~QCurlAwaiter()
+{
+    QCurlOrphanNotifier::forget(this);
+}
+
+/*!
+    \fn void QCurlAwaiter::readyRead()
+
+    Called when new response data can be read with QCurl::read() or
+    QCurl::readAll(). It is not called for requests that write the
+    response to a device.
+*/
+
+/*!
+    \fn void QCurlAwaiter::finished(const QCurlReply &reply)
+
+    Called once when the request finished, with its \a reply. The
+    awaiter is detached from the request after this call.
+*/
+
+/****************************************************
+ *
+ * QCurlSink
+ *
+ ****************************************************/
+
+/*!
+    \class QCurlSink
+    \brief The QCurlSink class consumes a response as it is read.
+
+    \inmodule QtNetwork
+
+    A sink is attached to a request with QCurl::setSink(). It gets the
+    body without going through signals or a QIODevice, as pointers
+    into the receive buffer, which suits consumers that process the
+    data in a single pass, such as parsers and hash functions.
+
+    The functions are called with the QCurl object in the middle of its
+    work and must not delete it.
+*/
+
+/*!
+    Destroys the sink.
+*/
+QCurlSink::~QCurlSink()
+{
+}
+
+/*!
+    \fn void QCurlSink::onHeaders(const QCurlResponseHeader &header)
+
+    Called with the response \a header before any of the body.
+*/
+
+/*!
+    \fn void QCurlSink::onData(const char *data, size_t size)
+
+    Called with the next \a size bytes of the body at \a data. The
+    data is only valid during the call.
+*/
+
+/*!
+    \fn void QCurlSink::onComplete(QCurl::Error error)
+
+    Called once when the request finished, with NoError or the \a
+    error it failed with. The sink is detached from the request after
+    this call.
+*/
+
+/****************************************************
+ *
+ * QCurlReply
+ *
+ ****************************************************/
+
+class QCurlReplyPrivate : public QSharedData
+{
+public:
+    QCurlReplyPrivate() : id(0), error(QCurl::NoError)
+    { }
+
+    int id;
+    QCurl::Error error;
+    QString errorString;
+    QCurlResponseHeader header;
+    QByteArray body;
+};
+
+/*!
+    \class QCurlReply
+    \brief The QCurlReply class holds the outcome of a finished request.
+
+    \inmodule QtNetwork
+
+    A reply carries everything a request produced: the response header,
+    the body and, if it failed, the error. It is implicitly shared, so
+    passing it along across threads or signal connections does not copy
+    the body.
+
+    \sa QCurlEngine
+*/
+
+/*!
+    Constructs an invalid reply.
+*/
+QCurlReply::QCurlReply()
+    : d(new QCurlReplyPrivate)
+{
+}
+
+/*!
+    Constructs a reply for the request \a id that finished with \a
+    error (NoError if it succeeded) described by \a errorString, and
+    received the response header \a header and the body \a body.
+*/
+QCurlReply::QCurlReply(int id, QCurl::Error error, const QString &errorString,
+                       const QCurlResponseHeader &header, const QByteArray &body)
+    : d(new QCurlReplyPrivate)
+{
+    d->id = id;
+    d->error = error;
+    d->errorString = errorString;
+    d->header = header;
+    d->body = body;
+}
+
+/*!
+    Constructs a copy of \a other.
+*/
+QCurlReply::QCurlReply(const QCurlReply &other)
+    : d(other.d)
+{
+}
+
+/*!
+    Destroys the reply.
+*/
+QCurlReply::~QCurlReply()
+{
+}
+
+/*!
+    Assigns \a other to this reply and returns a reference to it.
+*/
+QCurlReply &QCurlReply::operator=(const QCurlReply &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+    Returns true if this reply belongs to a request, false if it was
+    default constructed.
+*/
+bool QCurlReply::isValid() const
+{
+    return d->id != 0;
+}
+
+/*!
+    Returns the identifier of the request this reply belongs to.
+*/
+int QCurlReply::id() const
+{
+    return d->id;
+}
+
+/*!
+    Returns the error the request failed with, or NoError.
+
+    \sa errorString()
+*/
+QCurl::Error QCurlReply::error() const
+{
+    return d->error;
+}
+
+/*!
+    Returns a human-readable description of error().
+*/
+QString QCurlReply::errorString() const
+{
+    return d->errorString;
+}
+
+/*!
+    Returns the response header. It is invalid if the request failed
+    before a response arrived.
+*/
+QCurlResponseHeader QCurlReply::header() const
+{
+    return d->header;
+}
+
+/*!
+    Returns the status code of the response, or 0 if there was none.
+*/
+int QCurlReply::statusCode() const
+{
+    return d->header.isValid() ? d->header.statusCode() : 0;
+}
+
+/*!
+    Returns the response body.
+*/
+QByteArray QCurlReply::body() const
+{
+    return d->body;
+}
+
 QT_END_NAMESPACE
 
 #include "moc_qcurl.cpp"
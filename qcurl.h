@@ -7,8 +7,14 @@
 #include <QtCore/qmap.h>
 #include <QtCore/qpair.h>
 #include <QtCore/qscopedpointer.h>
+#include <QtCore/qshareddata.h>
+#include <QtCore/qmetatype.h>
+#include <QtCore/qfuture.h>
+#include <QtCore/qvector.h>
 #include <QObject>
 
+#include <functional>
+
 QT_BEGIN_HEADER
 
 class QTcpSocket;
@@ -19,8 +25,15 @@ class QNetworkProxy;
 class QSslError;
 
 class QCurlPrivate;
+class QCurlRetryPolicy;
+class QCurlReply;
+class QCurlReplyPrivate;
+class QCurlAwaiter;
+class QCurlSink;
 
 class QCurlHeaderPrivate;
+template <> QCurlHeaderPrivate *QSharedDataPointer<QCurlHeaderPrivate>::clone();
+
 class QCurlHeader
 {
 public:
@@ -64,10 +77,15 @@ protected:
 
     QCurlHeader(QCurlHeaderPrivate &dd, const QString &str = QString());
     QCurlHeader(QCurlHeaderPrivate &dd, const QCurlHeader &header);
-    QScopedPointer<QCurlHeaderPrivate> d_ptr;
+#ifdef Q_COMPILER_RVALUE_REFS
+    QCurlHeader(QCurlHeader &&header);
+#endif
+    // implicitly shared: the non-const d_func() detaches
+    QSharedDataPointer<QCurlHeaderPrivate> d_ptr;
 
 private:
-    Q_DECLARE_PRIVATE(QCurlHeader)
+    inline QCurlHeaderPrivate *d_func() { return d_ptr.data(); }
+    inline const QCurlHeaderPrivate *d_func() const { return d_ptr.constData(); }
 };
 
 class QCurlResponseHeaderPrivate;
@@ -79,6 +97,10 @@ public:
     QCurlResponseHeader(const QString &str);
     QCurlResponseHeader(int code, const QString &text = QString(), int majorVer = 1, int minorVer = 1);
     QCurlResponseHeader &operator=(const QCurlResponseHeader &header);
+#ifdef Q_COMPILER_RVALUE_REFS
+    QCurlResponseHeader(QCurlResponseHeader &&header);
+    QCurlResponseHeader &operator=(QCurlResponseHeader &&header);
+#endif
 
     void setStatusLine(int code, const QString &text = QString(), int majorVer = 1, int minorVer = 1);
 
@@ -94,7 +116,10 @@ protected:
     bool parseLine(const QString &line, int number);
 
 private:
-    Q_DECLARE_PRIVATE(QCurlResponseHeader)
+    inline QCurlResponseHeaderPrivate *d_func()
+    { return reinterpret_cast<QCurlResponseHeaderPrivate *>(d_ptr.data()); }
+    inline const QCurlResponseHeaderPrivate *d_func() const
+    { return reinterpret_cast<const QCurlResponseHeaderPrivate *>(d_ptr.constData()); }
     friend class QCurlPrivate;
 };
 
@@ -107,6 +132,10 @@ public:
     QCurlRequestHeader(const QCurlRequestHeader &header);
     QCurlRequestHeader(const QString &str);
     QCurlRequestHeader &operator=(const QCurlRequestHeader &header);
+#ifdef Q_COMPILER_RVALUE_REFS
+    QCurlRequestHeader(QCurlRequestHeader &&header);
+    QCurlRequestHeader &operator=(QCurlRequestHeader &&header);
+#endif
 
     void setRequest(const QString &method, const QString &path, int majorVer = 1, int minorVer = 1);
 
@@ -122,9 +151,51 @@ protected:
     bool parseLine(const QString &line, int number);
 
 private:
-    Q_DECLARE_PRIVATE(QCurlRequestHeader)
+    inline QCurlRequestHeaderPrivate *d_func()
+    { return reinterpret_cast<QCurlRequestHeaderPrivate *>(d_ptr.data()); }
+    inline const QCurlRequestHeaderPrivate *d_func() const
+    { return reinterpret_cast<const QCurlRequestHeaderPrivate *>(d_ptr.constData()); }
+};
+
+class QCurlRequestTemplatePrivate;
+class QCURLSHARED_EXPORT QCurlRequestTemplate
+{
+public:
+    QCurlRequestTemplate();
+    explicit QCurlRequestTemplate(const QString &method);
+    QCurlRequestTemplate(const QCurlRequestTemplate &other);
+    ~QCurlRequestTemplate();
+
+    QCurlRequestTemplate &operator=(const QCurlRequestTemplate &other);
+
+    QString method() const;
+
+    void setValue(const QString &key, const QString &value);
+    QString value(const QString &key) const;
+    void removeValue(const QString &key);
+
+    QCurlRequestHeader header(const QString &path) const;
+
+private:
+    QSharedDataPointer<QCurlRequestTemplatePrivate> d;
+
+    friend class QCurlTemplateRequest;
 };
 
+struct QCurlRequestDescriptor
+{
+    QCurlRequestDescriptor()
+    { }
+    QCurlRequestDescriptor(const QString &m, const QString &p, const QByteArray &d = QByteArray())
+        : method(m), path(p), data(d)
+    { }
+
+    QString method;     // GET when empty
+    QString path;
+    QByteArray data;    // no content is sent when null
+};
+Q_DECLARE_TYPEINFO(QCurlRequestDescriptor, Q_MOVABLE_TYPE);
+
 class QCURLSHARED_EXPORT QCurl : public QObject
 {
     Q_OBJECT
@@ -159,11 +230,41 @@ public:
         WrongContentLength,
         Aborted,
         AuthenticationRequiredError,
-        ProxyAuthenticationRequiredError
+        ProxyAuthenticationRequiredError,
+        TimeoutError
+    };
+    enum Timeout {
+        TransferTimeout,
+        HostLookupTimeout,
+        ConnectTimeout,
+        EncryptionTimeout,
+        FirstByteTimeout,
+        ReadIdleTimeout
+    };
+    enum ErrorPolicy {
+        AbortPendingOnError,
+        ContinueOnError
+    };
+    enum Priority {
+        LowPriority,
+        NormalPriority,
+        HighPriority
+    };
+    enum SocketOption {
+        LowDelayOption,
+        SendBufferSizeOption,
+        ReceiveBufferSizeOption,
+        QuickAckOption,
+        FastOpenOption,
+        KeepAliveOption,
+        KeepAliveIdleOption,
+        KeepAliveIntervalOption,
+        KeepAliveCountOption
     };
 
     int setHost(const QString &hostname, quint16 port = 80);
     int setHost(const QString &hostname, ConnectionMode mode, quint16 port = 0);
+    int setLocalServer(const QString &serverName, const QString &hostName = QString());
 
     int setSocket(QTcpSocket *socket);
     int setUser(const QString &username, const QString &password = QString());
@@ -178,13 +279,79 @@ public:
     int get(const QString &path, QIODevice *to=0);
     int post(const QString &path, QIODevice *data, QIODevice *to=0 );
     int post(const QString &path, const QByteArray &data, QIODevice *to=0);
+#ifdef Q_COMPILER_RVALUE_REFS
+    int post(const QString &path, QByteArray &&data, QIODevice *to=0);
+#endif
     int head(const QString &path);
     int request(const QCurlRequestHeader &header, QIODevice *device=0, QIODevice *to=0);
     int request(const QCurlRequestHeader &header, const QByteArray &data, QIODevice *to=0);
+#ifdef Q_COMPILER_RVALUE_REFS
+    int request(const QCurlRequestHeader &header, QByteArray &&data, QIODevice *to=0);
+#endif
+    int request(const QCurlRequestTemplate &tmpl, const QString &path,
+                const QByteArray &data = QByteArray(), QIODevice *to=0);
+    int request(const QCurlRequestTemplate &tmpl, const QString &path,
+                const QList<QPair<QByteArray, QByteArray> > &values,
+                const QByteArray &data = QByteArray(), QIODevice *to=0);
+    QCurlReply execute(const QCurlRequestHeader &header, const QByteArray &data = QByteArray(), int msecs = 30000);
+
+    int submitBatch(const QVector<QCurlRequestDescriptor> &requests);
+    int submitBatch(const QVector<QCurlRequestDescriptor> &requests, const QObject *context,
+                    std::function<void(int index, const QCurlReply &reply)> callback);
 
     int closeConnection();
     int close();
 
+    void setKeepAliveTimeout(int msecs);
+    int keepAliveTimeout() const;
+
+    void setSocketOption(SocketOption option, int value);
+    int socketOption(SocketOption option) const;
+
+    void setTimeout(Timeout type, int msecs);
+    int timeout(Timeout type) const;
+    bool setRequestTimeout(int id, Timeout type, int msecs);
+
+    void setErrorPolicy(ErrorPolicy policy);
+    ErrorPolicy errorPolicy() const;
+
+    void setRetryPolicy(QCurlRetryPolicy *policy);
+    QCurlRetryPolicy *retryPolicy() const;
+    bool setRequestRetryPolicy(int id, QCurlRetryPolicy *policy);
+
+    void setHedgingEnabled(bool enable);
+    bool isHedgingEnabled() const;
+    void setHedgingPercentile(int percentile);
+    int hedgingPercentile() const;
+    void setHedgingHost(const QString &hostName, quint16 port = 0);
+
+    bool setPriority(int id, Priority priority);
+    Priority priority(int id) const;
+    bool setRequestFlow(int id, const QString &flow);
+    void setFlowWeight(const QString &flow, int weight);
+    int flowWeight(const QString &flow) const;
+
+    void setDownloadRateLimit(qint64 bytesPerSecond);
+    qint64 downloadRateLimit() const;
+    void setUploadRateLimit(qint64 bytesPerSecond);
+    qint64 uploadRateLimit() const;
+    void setRequestRateLimit(const QString &hostName, qreal requestsPerSecond);
+    qreal requestRateLimit(const QString &hostName) const;
+
+    static void setGlobalDownloadRateLimit(qint64 bytesPerSecond);
+    static qint64 globalDownloadRateLimit();
+    static void setGlobalUploadRateLimit(qint64 bytesPerSecond);
+    static qint64 globalUploadRateLimit();
+    static void setGlobalRequestRateLimit(const QString &hostName, qreal requestsPerSecond);
+    static qreal globalRequestRateLimit(const QString &hostName);
+
+    void setReadBufferSize(qint64 size);
+    qint64 readBufferSize() const;
+
+    void setNotificationInterval(qint64 bytes, int msecs);
+    qint64 notificationBytes() const;
+    int notificationInterval() const;
+
     qint64 bytesAvailable() const;
     qint64 read(char *data, qint64 maxlen);
     QByteArray readAll();
@@ -196,6 +363,12 @@ public:
     QCurlResponseHeader lastResponse() const;
     bool hasPendingRequests() const;
     void clearPendingRequests();
+    bool cancel(int id);
+    bool setAwaiter(int id, QCurlAwaiter *awaiter);
+    bool setSink(int id, QCurlSink *sink);
+#ifndef QT_NO_QFUTURE
+    QFuture<QCurlReply> future(int id);
+#endif
 
     State state() const;
 
@@ -220,6 +393,7 @@ Q_SIGNALS:
 
     void requestStarted(int);
     void requestFinished(int, bool);
+    void batchFinished(int batchId, int failed);
     void done(bool);
 
 #ifndef QT_NO_NETWORKPROXY
@@ -245,6 +419,19 @@ private:
     Q_PRIVATE_SLOT(d, void _q_slotDoFinished())
     Q_PRIVATE_SLOT(d, void _q_slotSendRequest())
     Q_PRIVATE_SLOT(d, void _q_continuePost())
+    Q_PRIVATE_SLOT(d, void _q_slotIdleTimeout())
+    Q_PRIVATE_SLOT(d, void _q_slotHostFound())
+    Q_PRIVATE_SLOT(d, void _q_slotEncrypted())
+    Q_PRIVATE_SLOT(d, void _q_slotTransferTimeout())
+    Q_PRIVATE_SLOT(d, void _q_slotPhaseTimeout())
+    Q_PRIVATE_SLOT(d, void _q_slotRetry())
+    Q_PRIVATE_SLOT(d, void _q_slotHedge())
+    Q_PRIVATE_SLOT(d, void _q_slotHedgeFinished(int, bool))
+    Q_PRIVATE_SLOT(d, void _q_slotPaceRead())
+    Q_PRIVATE_SLOT(d, void _q_slotPaceWrite())
+    Q_PRIVATE_SLOT(d, void _q_slotDeviceBytesWritten())
+    Q_PRIVATE_SLOT(d, void _q_slotFlushNotifications())
+    Q_PRIVATE_SLOT(d, void _q_callAwaiters())
 
     friend class QCurlNormalRequest;
     friend class QCurlSetHostRequest;
@@ -253,6 +440,82 @@ private:
     friend class QCurlSetProxyRequest;
     friend class QCurlCloseRequest;
     friend class QCurlPGHRequest;
+    friend class QCurlTemplateRequest;
+};
+
+class QCurlRetryPolicyPrivate;
+class QCURLSHARED_EXPORT QCurlRetryPolicy
+{
+public:
+    QCurlRetryPolicy();
+    virtual ~QCurlRetryPolicy();
+
+    void setMaximumAttempts(int attempts);
+    int maximumAttempts() const;
+
+    void setBackoff(int initialDelay, int maximumDelay);
+    int initialDelay() const;
+    int maximumDelay() const;
+
+    void setRetryableErrors(const QList<QCurl::Error> &errors);
+    QList<QCurl::Error> retryableErrors() const;
+    void setRetryableStatusCodes(const QList<int> &codes);
+    QList<int> retryableStatusCodes() const;
+
+    void setRetryNonIdempotent(bool enable);
+    bool retryNonIdempotent() const;
+
+    virtual bool shouldRetry(const QCurlRequestHeader &request, QCurl::Error error,
+                             const QCurlResponseHeader &response, int attempt) const;
+    virtual int retryDelay(const QCurlResponseHeader &response, int attempt) const;
+
+private:
+    Q_DISABLE_COPY(QCurlRetryPolicy)
+    QScopedPointer<QCurlRetryPolicyPrivate> d;
+};
+
+class QCURLSHARED_EXPORT QCurlReply
+{
+public:
+    QCurlReply();
+    QCurlReply(int id, QCurl::Error error, const QString &errorString,
+               const QCurlResponseHeader &header, const QByteArray &body);
+    QCurlReply(const QCurlReply &other);
+    ~QCurlReply();
+
+    QCurlReply &operator=(const QCurlReply &other);
+
+    bool isValid() const;
+    int id() const;
+    QCurl::Error error() const;
+    QString errorString() const;
+    QCurlResponseHeader header() const;
+    int statusCode() const;
+    QByteArray body() const;
+
+private:
+    QSharedDataPointer<QCurlReplyPrivate> d;
+};
+
+Q_DECLARE_METATYPE(QCurlReply)
+
+class QCURLSHARED_EXPORT QCurlAwaiter
+{
+public:
+    virtual ~QCurlAwaiter();
+
+    virtual void readyRead() = 0;
+    virtual void finished(const QCurlReply &reply) = 0;
+};
+
+class QCURLSHARED_EXPORT QCurlSink
+{
+public:
+    virtual ~QCurlSink();
+
+    virtual void onHeaders(const QCurlResponseHeader &header) = 0;
+    virtual void onData(const char *data, size_t size) = 0;
+    virtual void onComplete(QCurl::Error error) = 0;
 };
 
 QT_END_HEADER
@@ -9,4 +9,11 @@
 #  define QCURLSHARED_EXPORT Q_DECL_IMPORT
 #endif
 
+// private classes the autotests use; only exported by a developer build
+#if defined(QCURL_BUILD_INTERNAL)
+#  define QCURL_AUTOTEST_EXPORT QCURLSHARED_EXPORT
+#else
+#  define QCURL_AUTOTEST_EXPORT
+#endif
+
 #endif // QCURL_GLOBAL_H
@@ -0,0 +1,183 @@
+#ifndef QCURLCORO_H
+#define QCURLCORO_H
+
+#include "qcurl.h"
+#include <QtCore/qpointer.h>
+
+// C++20 coroutine support: awaitables on top of QCurlAwaiter, which is
+// called right after the network event, once QCurl is done with it.
+//
+//     QCurlReply reply = co_await qCurlAwait(&curl, curl.get("/index.html"));
+//
+//     QCurlBodyStream stream(&curl, curl.get("/large.iso"));
+//     for (QByteArray chunk = co_await stream.next(); !chunk.isNull();
+//          chunk = co_await stream.next())
+//         hash.addData(chunk);
+
+#if defined(__has_include)
+#  if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#    define QCURL_HAS_COROUTINES
+#  endif
+#endif
+
+#ifdef QCURL_HAS_COROUTINES
+
+#include <coroutine>
+
+QT_BEGIN_HEADER
+
+/*
+    Suspends until a request finished and yields its reply. A request
+    that does not exist (anymore) yields an invalid reply right away.
+*/
+class QCurlReplyAwaitable : public QCurlAwaiter
+{
+public:
+    QCurlReplyAwaitable(QCurl *curl, int id)
+        : curl(curl), id(id), registered(false), done(false)
+    { }
+
+    ~QCurlReplyAwaitable()
+    {
+        // the coroutine went away while waiting
+        if (registered && !done && curl)
+            curl->setAwaiter(id, 0);
+    }
+
+    bool await_ready() const noexcept { return done; }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        handle = h;
+        if (curl && curl->setAwaiter(id, this)) {
+            registered = true;
+            return true;
+        }
+        done = true;
+        return false;
+    }
+
+    QCurlReply await_resume() { return result; }
+
+private:
+    void readyRead() { }
+
+    void finished(const QCurlReply &reply)
+    {
+        result = reply;
+        done = true;
+        handle.resume();
+    }
+
+    QPointer<QCurl> curl;
+    int id;
+    bool registered;        // only then is the awaiter ours to remove
+    bool done;
+    QCurlReply result;
+    std::coroutine_handle<> handle;
+};
+
+inline QCurlReplyAwaitable qCurlAwait(QCurl *curl, int id)
+{
+    return QCurlReplyAwaitable(curl, id);
+}
+
+/*
+    An asynchronous stream of the body chunks of a request, in the order
+    they arrive. co_await next() yields the data buffered since the last
+    call, suspending until there is some, and a null QByteArray once the
+    request finished; reply() then has the outcome. The request must not
+    write to a destination device, and the stream has to be set up
+    before control returns to the event loop so that no data is missed.
+*/
+class QCurlBodyStream : public QCurlAwaiter
+{
+public:
+    class Next
+    {
+    public:
+        explicit Next(QCurlBodyStream *stream) : stream(stream) { }
+
+        bool await_ready() const noexcept { return stream->hasChunk(); }
+        void await_suspend(std::coroutine_handle<> h) { stream->waiting = h; }
+        QByteArray await_resume() { return stream->takeChunk(); }
+
+    private:
+        QCurlBodyStream *stream;
+    };
+
+    QCurlBodyStream(QCurl *curl, int id)
+        : curl(curl), id(id), primed(false), ended(false), tailTaken(false)
+    {
+        if (!curl->setAwaiter(id, this))
+            ended = true;
+    }
+
+    ~QCurlBodyStream()
+    {
+        if (!ended && curl)
+            curl->setAwaiter(id, 0);
+    }
+
+    Next next() { return Next(this); }
+    bool atEnd() const { return ended && tailTaken; }
+    QCurlReply reply() const { return result; }
+
+private:
+    Q_DISABLE_COPY(QCurlBodyStream)
+
+    bool hasChunk() const
+    {
+        return ended || (primed && curl && curl->bytesAvailable() > 0);
+    }
+
+    QByteArray takeChunk()
+    {
+        if (!ended)
+            return curl ? curl->readAll() : QByteArray();
+        if (!tailTaken) {
+            // what arrived after the last resumption went into the reply
+            tailTaken = true;
+            QByteArray tail = result.body();
+            if (!tail.isEmpty())
+                return tail;
+        }
+        return QByteArray();
+    }
+
+    void resumeWaiting()
+    {
+        if (!waiting)
+            return;
+        std::coroutine_handle<> h = waiting;
+        waiting = std::coroutine_handle<>();
+        h.resume();
+    }
+
+    void readyRead()
+    {
+        primed = true;
+        resumeWaiting();
+    }
+
+    void finished(const QCurlReply &reply)
+    {
+        result = reply;
+        ended = true;
+        resumeWaiting();
+    }
+
+    QPointer<QCurl> curl;
+    int id;
+    bool primed;
+    bool ended;
+    bool tailTaken;
+    QCurlReply result;
+    std::coroutine_handle<> waiting;
+};
+
+QT_END_HEADER
+
+#endif // QCURL_HAS_COROUTINES
+
+#endif // QCURLCORO_H
@@ -0,0 +1,561 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+#include "qcurlengine.h"
+#include "qcurlengine_p.h"
+
+#include "qthread.h"
+#include "qtimer.h"
+
+QT_BEGIN_NAMESPACE
+
+/****************************************************
+ *
+ * QCurlEngineWorker
+ *
+ ****************************************************/
+
+QCurlEngineWorker::QCurlEngineWorker(QCurlEngine *e)
+    : engine(e), wakeupPending(false)
+{
+}
+
+// May be called from any thread.
+void QCurlEngineWorker::enqueue(const QCurlEngineJob &job)
+{
+    {
+        QMutexLocker locker(&mutex);
+        queue.append(job);
+        // one wakeup is enough for whatever piles up until it runs
+        if (wakeupPending)
+            return;
+        wakeupPending = true;
+    }
+    QMetaObject::invokeMethod(this, "processJobs", Qt::QueuedConnection);
+}
+
+// May be called from any thread.
+void QCurlEngineWorker::cancel(int ticket)
+{
+    QMetaObject::invokeMethod(this, "cancelJob", Qt::QueuedConnection, Q_ARG(int, ticket));
+}
+
+/*
+    May be called from any thread: hands the most recently queued job
+    over to an idle worker. The oldest ones stay, they are next in line
+    here anyway.
+*/
+bool QCurlEngineWorker::steal(QCurlEngineJob *job)
+{
+    QMutexLocker locker(&mutex);
+    if (queue.isEmpty())
+        return false;
+    *job = queue.takeLast();
+    return true;
+}
+
+void QCurlEngineWorker::processJobs()
+{
+    QList<QPair<QCurlEngineJob, QCurl *> > startable;
+    bool backlog;
+    {
+        QMutexLocker locker(&mutex);
+        wakeupPending = false;
+        int i = 0;
+        while (i < queue.count()) {
+            QCurl *curl = idleConnection(queue.at(i).url);
+            if (curl) {
+                busy.insert(curl);
+                startable.append(qMakePair(queue.takeAt(i), curl));
+            } else {
+                ++i;    // its host is at the connection limit
+            }
+        }
+        backlog = !queue.isEmpty();
+    }
+
+    for (int i = 0; i < startable.count(); ++i)
+        start(startable.at(i).first, startable.at(i).second);
+
+    if (backlog)
+        engine->d->wakeIdleWorker();
+    else if (running.isEmpty())
+        stealJobs();
+}
+
+/*
+    Runs queued jobs of other workers while this one has nothing to do,
+    or puts it on the engine's idle list.
+*/
+void QCurlEngineWorker::stealJobs()
+{
+    QCurlEngineJob job;
+    while (engine->d->stealFor(this, &job, running.isEmpty())) {
+        QCurl *curl = idleConnection(job.url);
+        if (!curl) {
+            // this pool is full for that host as well; keep it here
+            enqueue(job);
+            return;
+        }
+        busy.insert(curl);
+        start(job, curl);
+    }
+}
+
+void QCurlEngineWorker::start(const QCurlEngineJob &job, QCurl *curl)
+{
+    QCurlRequestHeader header = job.header;
+    QString path = QString::fromLatin1(job.url.toEncoded(QUrl::RemoveScheme | QUrl::RemoveAuthority
+                                                         | QUrl::RemoveFragment));
+    if (path.isEmpty())
+        path = QLatin1String("/");
+    QString method = header.method().isEmpty() ? QString::fromLatin1("GET") : header.method();
+    header.setRequest(method, path, header.majorVersion(), header.minorVersion());
+    if (!header.hasKey(QLatin1String("host"))) {
+        int port = job.url.port();
+        if (port == -1)
+            header.setValue(QLatin1String("Host"), job.url.host());
+        else
+            header.setValue(QLatin1String("Host"), job.url.host() + QLatin1Char(':') + QString::number(port));
+    }
+
+    // a null body sends no Content-Length at all, an empty one sends 0
+    int id = job.data.isNull() ? curl->request(header, static_cast<QIODevice *>(0))
+                               : curl->request(header, job.data);
+    Running r;
+    r.job = job;
+    r.curl = curl;
+    running.insert(id, r);
+}
+
+void QCurlEngineWorker::cancelJob(int ticket)
+{
+    {
+        QMutexLocker locker(&mutex);
+        for (int i = 0; i < queue.count(); ++i) {
+            if (queue.at(i).ticket == ticket) {
+                QCurlEngineJob job = queue.takeAt(i);
+                locker.unlock();
+                deliver(job, QCurlReply(ticket, QCurl::Aborted,
+                                        QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted")),
+                                        QCurlResponseHeader(), QByteArray()));
+                return;
+            }
+        }
+    }
+
+    QHash<int, Running>::Iterator it = running.begin();
+    for (; it != running.end(); ++it) {
+        if (it->job.ticket == ticket)
+            break;
+    }
+    if (it == running.end())
+        return;
+
+    int id = it.key();
+    QCurl *curl = it->curl;
+    // the running request reports itself through requestFinished(),
+    // one still behind the setHost() of a new connection just disappears
+    bool current = curl->currentId() == id;
+    if (curl->cancel(id) && !current) {
+        QCurlEngineJob job = it->job;
+        running.erase(it);
+        busy.remove(curl);
+        deliver(job, QCurlReply(ticket, QCurl::Aborted,
+                                QLatin1String(QT_TRANSLATE_NOOP("QCurl", "Request aborted")),
+                                QCurlResponseHeader(), QByteArray()));
+        processJobs();
+    }
+}
+
+void QCurlEngineWorker::requestFinished(int id, bool error)
+{
+    QCurl *curl = qobject_cast<QCurl *>(sender());
+    QHash<int, Running>::Iterator it = running.find(id);
+    if (!curl || it == running.end())
+        return;     // setHost() and friends
+
+    Running r = *it;
+    running.erase(it);
+    busy.remove(curl);
+    QByteArray body = curl->readAll();
+    if (error)
+        deliver(r.job, QCurlReply(r.job.ticket, curl->error(), curl->errorString(), r.response, body));
+    else
+        deliver(r.job, QCurlReply(r.job.ticket, QCurl::NoError, QString(), r.response, body));
+
+    // the connection is free for the next job, from here or elsewhere;
+    // not from within QCurl's signal though
+    {
+        QMutexLocker locker(&mutex);
+        if (wakeupPending)
+            return;
+        wakeupPending = true;
+    }
+    QMetaObject::invokeMethod(this, "processJobs", Qt::QueuedConnection);
+}
+
+void QCurlEngineWorker::responseHeaderReceived(const QCurlResponseHeader &response)
+{
+    QCurl *curl = qobject_cast<QCurl *>(sender());
+    if (!curl)
+        return;
+    QHash<int, Running>::Iterator it = running.find(curl->currentId());
+    if (it != running.end())
+        it->response = response;
+}
+
+/*
+    Returns a connection to the server of \a url that is not running a
+    request, creating one while the pool for that server is below the
+    per-host limit, or 0 if all of them are busy.
+*/
+QCurl *QCurlEngineWorker::idleConnection(const QUrl &url)
+{
+    bool https = url.scheme().compare(QLatin1String("https"), Qt::CaseInsensitive) == 0;
+    int port = url.port(https ? 443 : 80);
+    QString server = engine->localServer(url.host());
+    QString key = url.scheme().toLower() + QLatin1String("://") + url.host().toLower()
+                  + QLatin1Char(':') + QString::number(port);
+    if (!server.isEmpty())
+        key += QLatin1Char('@') + server;
+
+    QList<QCurl *> &connections = pool[key];
+    for (int i = 0; i < connections.count(); ++i) {
+        if (!busy.contains(connections.at(i)))
+            return connections.at(i);
+    }
+    if (connections.count() >= engine->d->maxConnectionsPerHost.load())
+        return 0;
+
+    QCurl *curl = new QCurl(this);
+    // a failed request must not take anything else with it
+    curl->setErrorPolicy(QCurl::ContinueOnError);
+    if (!server.isEmpty())
+        curl->setLocalServer(server, url.host());
+    else
+        curl->setHost(url.host(), https ? QCurl::ConnectionModeHttps : QCurl::ConnectionModeHttp, port);
+    if (!url.userName().isEmpty())
+        curl->setUser(url.userName(), url.password());
+    connect(curl, SIGNAL(requestFinished(int,bool)), this, SLOT(requestFinished(int,bool)));
+    connect(curl, SIGNAL(responseHeaderReceived(QCurlResponseHeader)),
+            this, SLOT(responseHeaderReceived(QCurlResponseHeader)));
+    connections.append(curl);
+    return curl;
+}
+
+void QCurlEngineWorker::deliver(const QCurlEngineJob &job, const QCurlReply &reply)
+{
+    // queued to the receivers, as the engine lives in another thread
+    emit engine->finished(job.ticket, reply);
+
+    if (job.callback && job.context) {
+        std::function<void (const QCurlReply &)> callback = job.callback;
+        QTimer::singleShot(0, job.context.data(), [callback, reply]() { callback(reply); });
+    }
+}
+
+/****************************************************
+ *
+ * QCurlEngine
+ *
+ ****************************************************/
+
+void QCurlEnginePrivate::init(QCurlEngine *q, int threadCount)
+{
+    qRegisterMetaType<QCurlReply>();
+    if (threadCount <= 0)
+        threadCount = QThread::idealThreadCount();
+    for (int i = 0; i < qMax(1, threadCount); ++i) {
+        QThread *thread = new QThread;
+        QCurlEngineWorker *worker = new QCurlEngineWorker(q);
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        thread->start();
+        threads.append(thread);
+        workers.append(worker);
+    }
+}
+
+QCurlEngineWorker *QCurlEnginePrivate::workerFor(const QUrl &url) const
+{
+    // all requests for one host go to the same thread, which keeps its
+    // connections to it warm
+    return workers.at(qHash(url.host().toLower()) % uint(workers.count()));
+}
+
+void QCurlEnginePrivate::wakeIdleWorker()
+{
+    QMutexLocker locker(&idleMutex);
+    if (!stopping && !idle.isEmpty())
+        QMetaObject::invokeMethod(idle.takeFirst(), "stealJobs", Qt::QueuedConnection);
+}
+
+/*
+    Finds a queued job of another worker for \a thief, or else files
+    it as idle if \a markIdle is set. Both happen under idleMutex, so
+    that a backlog showing up meanwhile either is found here or wakes
+    the thief up.
+*/
+bool QCurlEnginePrivate::stealFor(QCurlEngineWorker *thief, QCurlEngineJob *job, bool markIdle)
+{
+    QMutexLocker locker(&idleMutex);
+    if (stopping)
+        return false;
+    idle.removeAll(thief);
+    for (int i = 0; i < workers.count(); ++i) {
+        QCurlEngineWorker *victim = workers.at(i);
+        if (victim != thief && victim->steal(job))
+            return true;
+    }
+    if (markIdle)
+        idle.append(thief);
+    return false;
+}
+
+/*!
+    \class QCurlEngine
+    \brief The QCurlEngine class runs HTTP requests on dedicated network
+    threads.
+
+    \inmodule QtNetwork
+
+    A QCurl object has to be used from the thread it lives in, and its
+    socket I/O and response parsing compete with everything else that
+    thread does. QCurlEngine moves that work to network threads of its
+    own, which own the QCurl objects and their connections.
+
+    Requests are submitted with get(), post() or submit(), which may be
+    called from any thread and return a ticket right away. When a
+    request finishes, the finished() signal is emitted with the ticket
+    and a QCurlReply holding the response; it reaches receivers in other
+    threads through queued connections. Alternatively submit() takes a
+    callback, which is called in the thread of a context object.
+
+    The threads share the work by host: all requests for one server are
+    routed to the same thread, which keeps a pool of persistent
+    connections to it (see setMaximumConnectionsPerHost()). A thread
+    that runs out of work takes queued requests over from busy ones, so
+    a few hot servers do not leave the other threads idle.
+
+    \sa QCurl QCurlReply
+*/
+
+/*!
+    Constructs an engine with one network thread and the parent \a
+    parent.
+*/
+QCurlEngine::QCurlEngine(QObject *parent)
+    : QObject(parent), d(new QCurlEnginePrivate)
+{
+    d->init(this, 1);
+}
+
+/*!
+    Constructs an engine with \a threadCount network threads and the
+    parent \a parent. If \a threadCount is 0, one thread per processor
+    core is used.
+*/
+QCurlEngine::QCurlEngine(int threadCount, QObject *parent)
+    : QObject(parent), d(new QCurlEnginePrivate)
+{
+    d->init(this, threadCount);
+}
+
+/*!
+    Destroys the engine. Requests that have not finished yet are
+    aborted without being reported.
+*/
+QCurlEngine::~QCurlEngine()
+{
+    {
+        // the workers go away one by one below; no stealing from them
+        QMutexLocker locker(&d->idleMutex);
+        d->stopping = true;
+        d->idle.clear();
+    }
+    for (int i = 0; i < d->threads.count(); ++i) {
+        QThread *thread = d->threads.at(i);
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
+
+/*!
+    Returns the number of network threads.
+*/
+int QCurlEngine::threadCount() const
+{
+    return d->threads.count();
+}
+
+/*!
+    Sets the number of connections each network thread may open to one
+    server to \a count. The default is 6. This function is thread-safe.
+
+    Requests for a server whose connections are all busy wait in the
+    queue of their thread, where an idle thread may pick them up.
+*/
+void QCurlEngine::setMaximumConnectionsPerHost(int count)
+{
+    d->maxConnectionsPerHost.store(qMax(1, count));
+}
+
+/*!
+    Returns the number of connections each network thread may open to
+    one server.
+
+    \sa setMaximumConnectionsPerHost()
+*/
+int QCurlEngine::maximumConnectionsPerHost() const
+{
+    return d->maxConnectionsPerHost.load();
+}
+
+/*!
+    Routes the requests for the host \a hostName to the local socket \a
+    serverName instead of a TCP connection, whatever the scheme and port
+    of their URLs; an empty \a serverName removes the route. The
+    connections to it are pooled like TCP ones. This function is
+    thread-safe; requests already running keep their connection.
+
+    \sa QCurl::setLocalServer()
+*/
+void QCurlEngine::setLocalServer(const QString &hostName, const QString &serverName)
+{
+    QMutexLocker locker(&d->localMutex);
+    if (serverName.isEmpty())
+        d->localServers.remove(hostName.toLower());
+    else
+        d->localServers.insert(hostName.toLower(), serverName);
+}
+
+/*!
+    Returns the local socket the requests for \a hostName are routed to,
+    or an empty string if they use TCP.
+
+    \sa setLocalServer()
+*/
+QString QCurlEngine::localServer(const QString &hostName) const
+{
+    QMutexLocker locker(&d->localMutex);
+    return d->localServers.value(hostName.toLower());
+}
+
+/*!
+    Submits a GET request for \a url and returns its ticket. This
+    function is thread-safe.
+
+    \sa finished()
+*/
+int QCurlEngine::get(const QUrl &url)
+{
+    return submit(url, QCurlRequestHeader(QLatin1String("GET"), QString()));
+}
+
+/*!
+    Submits a POST request sending \a data to \a url and returns its
+    ticket. This function is thread-safe.
+
+    \sa finished()
+*/
+int QCurlEngine::post(const QUrl &url, const QByteArray &data)
+{
+    return submit(url, QCurlRequestHeader(QLatin1String("POST"), QString()),
+                  data.isNull() ? QByteArray("") : data);
+}
+
+/*!
+    Submits a request for \a url with the method and header fields of
+    \a header and returns its ticket. The path of \a header is replaced
+    by the one of \a url, and a Host field is added unless \a header has
+    one. If \a data is not null, it is sent as the request body. This
+    function is thread-safe.
+
+    \sa finished() cancel()
+*/
+int QCurlEngine::submit(const QUrl &url, const QCurlRequestHeader &header, const QByteArray &data)
+{
+    return submit(url, header, data, 0, std::function<void (const QCurlReply &)>());
+}
+
+/*!
+    \overload
+
+    Submits a request like the function above and calls \a callback
+    with the reply when it finished, in the thread of \a context. If
+    \a context is destroyed before, the callback is not called. If \a
+    context is 0, the callback is called in the thread of the engine.
+    The finished() signal is emitted as well.
+*/
+int QCurlEngine::submit(const QUrl &url, const QCurlRequestHeader &header, const QByteArray &data,
+                        const QObject *context, std::function<void (const QCurlReply &)> callback)
+{
+    QCurlEngineJob job;
+    job.ticket = d->ticketCounter.fetchAndAddRelaxed(1);
+    job.url = url;
+    job.header = header;
+    job.data = data;
+    job.context = const_cast<QObject *>(context ? context : this);
+    job.callback = callback;
+    d->workerFor(url)->enqueue(job);
+    return job.ticket;
+}
+
+/*!
+    Cancels the request with the ticket \a ticket. If it has not
+    finished yet, it finishes with the error QCurl::Aborted. This
+    function is thread-safe.
+*/
+void QCurlEngine::cancel(int ticket)
+{
+    // the ticket does not tell which thread has it
+    for (int i = 0; i < d->workers.count(); ++i)
+        d->workers.at(i)->cancel(ticket);
+}
+
+/*!
+    \fn void QCurlEngine::finished(int ticket, const QCurlReply &reply)
+
+    This signal is emitted when the request with the ticket \a ticket
+    finished, successfully or not, with the reply \a reply.
+*/
+
+QT_END_NAMESPACE
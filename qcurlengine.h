@@ -0,0 +1,50 @@
+#ifndef QCURLENGINE_H
+#define QCURLENGINE_H
+
+#include "qcurl.h"
+#include <QtCore/qobject.h>
+#include <QtCore/qscopedpointer.h>
+
+#include <functional>
+
+QT_BEGIN_HEADER
+
+class QUrl;
+class QCurlEnginePrivate;
+
+class QCURLSHARED_EXPORT QCurlEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QCurlEngine(QObject *parent = 0);
+    explicit QCurlEngine(int threadCount, QObject *parent = 0);
+    ~QCurlEngine();
+
+    int threadCount() const;
+    void setMaximumConnectionsPerHost(int count);
+    int maximumConnectionsPerHost() const;
+    void setLocalServer(const QString &hostName, const QString &serverName);
+    QString localServer(const QString &hostName) const;
+
+    int get(const QUrl &url);
+    int post(const QUrl &url, const QByteArray &data);
+    int submit(const QUrl &url, const QCurlRequestHeader &header,
+               const QByteArray &data = QByteArray());
+    int submit(const QUrl &url, const QCurlRequestHeader &header, const QByteArray &data,
+               const QObject *context, std::function<void (const QCurlReply &)> callback);
+    void cancel(int ticket);
+
+Q_SIGNALS:
+    void finished(int ticket, const QCurlReply &reply);
+
+private:
+    Q_DISABLE_COPY(QCurlEngine)
+    QScopedPointer<QCurlEnginePrivate> d;
+
+    friend class QCurlEngineWorker;
+};
+
+QT_END_HEADER
+
+#endif // QCURLENGINE_H
@@ -0,0 +1,158 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCURLENGINE_P_H
+#define QCURLENGINE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qcurlengine.h"
+
+#include <qhash.h>
+#include <qlist.h>
+#include <qmutex.h>
+#include <qpointer.h>
+#include <qset.h>
+#include <qurl.h>
+
+QT_BEGIN_NAMESPACE
+
+class QThread;
+
+struct QCurlEngineJob
+{
+    QCurlEngineJob() : ticket(0)
+    { }
+
+    int ticket;
+    QUrl url;
+    QCurlRequestHeader header;
+    QByteArray data;
+    QPointer<QObject> context;   // where the callback runs
+    std::function<void (const QCurlReply &)> callback;
+};
+
+/*
+    Lives in one network thread and owns a pool of QCurl objects, each
+    one a keep-alive connection running one request at a time, for the
+    hosts routed to it. Jobs wait in the queue until a connection to
+    their host is free; an idle worker of another thread may steal them
+    meanwhile. The queue is shared under the mutex, everything else is
+    only touched from the worker's thread.
+*/
+class QCurlEngineWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QCurlEngineWorker(QCurlEngine *engine);
+
+    void enqueue(const QCurlEngineJob &job);
+    void cancel(int ticket);
+    bool steal(QCurlEngineJob *job);
+
+public Q_SLOTS:
+    void stealJobs();
+
+private Q_SLOTS:
+    void processJobs();
+    void cancelJob(int ticket);
+    void requestFinished(int id, bool error);
+    void responseHeaderReceived(const QCurlResponseHeader &response);
+
+private:
+    QCurl *idleConnection(const QUrl &url);
+    void start(const QCurlEngineJob &job, QCurl *curl);
+    void deliver(const QCurlEngineJob &job, const QCurlReply &reply);
+
+    struct Running {
+        QCurlEngineJob job;
+        QCurl *curl;
+        QCurlResponseHeader response;
+    };
+
+    QCurlEngine *engine;
+    QMutex mutex;
+    QList<QCurlEngineJob> queue;
+    bool wakeupPending;
+    QHash<QString, QList<QCurl *> > pool;   // connections by scheme, host and port
+    QSet<QCurl *> busy;
+    QHash<int, Running> running;            // by QCurl request id
+};
+
+class QCurlEnginePrivate
+{
+public:
+    QCurlEnginePrivate() : ticketCounter(1), maxConnectionsPerHost(6), stopping(false)
+    { }
+
+    void init(QCurlEngine *q, int threadCount);
+    QCurlEngineWorker *workerFor(const QUrl &url) const;
+    void wakeIdleWorker();
+    bool stealFor(QCurlEngineWorker *thief, QCurlEngineJob *job, bool markIdle);
+
+    QAtomicInt ticketCounter;
+    QAtomicInt maxConnectionsPerHost;
+    QList<QThread *> threads;
+    QList<QCurlEngineWorker *> workers;
+
+    // hosts reached through a local socket, by lower case host name
+    mutable QMutex localMutex;
+    QHash<QString, QString> localServers;
+
+    // workers with nothing to do, woken up when another one has a backlog
+    QMutex idleMutex;
+    QList<QCurlEngineWorker *> idle;
+    bool stopping;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCURLENGINE_P_H
@@ -0,0 +1,845 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+#include "qcurlepollsocket.h"
+#include "qcurlepollsocket_p.h"
+#include "qcurlsocketoptions_p.h"
+
+#include "qcoreevent.h"
+#include "qhostinfo.h"
+#include "qsocketnotifier.h"
+#include "qthreadstorage.h"
+
+#ifdef Q_OS_LINUX
+# include <sys/epoll.h>
+# include <sys/ioctl.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <errno.h>
+# include <poll.h>
+# include <string.h>
+# include <unistd.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+#ifdef Q_OS_LINUX
+// what a connected socket is watched for; edge-triggered, so that data
+// the consumer leaves in the kernel does not wake the event loop again
+// until more arrives
+static const quint32 QCurlEpollReadEvents = EPOLLIN | EPOLLRDHUP | EPOLLET;
+#endif
+
+Q_GLOBAL_STATIC(QThreadStorage<QCurlEpollDispatcher *>, epollDispatchers)
+
+/****************************************************
+ *
+ * QCurlEpollDispatcher
+ *
+ ****************************************************/
+
+QCurlEpollDispatcher::QCurlEpollDispatcher()
+    : epfd(-1), notifier(0)
+{
+#ifdef Q_OS_LINUX
+    epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epfd != -1) {
+        notifier = new QSocketNotifier(epfd, QSocketNotifier::Read, this);
+        connect(notifier, SIGNAL(activated(int)), this, SLOT(dispatch()));
+    }
+#endif
+}
+
+QCurlEpollDispatcher::~QCurlEpollDispatcher()
+{
+    // the thread storage deletes us with the thread, possibly before the
+    // sockets: they keep their descriptor, but must not call us anymore
+    QHash<int, QCurlEpollSocket *>::const_iterator it = sockets.constBegin();
+    for (; it != sockets.constEnd(); ++it)
+        it.value()->d->dispatcher = 0;
+    delete notifier;
+#ifdef Q_OS_LINUX
+    if (epfd != -1)
+        ::close(epfd);
+#endif
+}
+
+// the dispatcher of the current thread
+QCurlEpollDispatcher *QCurlEpollDispatcher::instance()
+{
+    QThreadStorage<QCurlEpollDispatcher *> *dispatchers = epollDispatchers();
+    if (!dispatchers->hasLocalData())
+        dispatchers->setLocalData(new QCurlEpollDispatcher);
+    return dispatchers->localData();
+}
+
+bool QCurlEpollDispatcher::watch(int fd, QCurlEpollSocket *socket, quint32 events)
+{
+#ifdef Q_OS_LINUX
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        return false;
+    sockets.insert(fd, socket);
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(socket);
+    Q_UNUSED(events);
+    return false;
+#endif
+}
+
+bool QCurlEpollDispatcher::modify(int fd, quint32 events)
+{
+#ifdef Q_OS_LINUX
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    return ::epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(events);
+    return false;
+#endif
+}
+
+void QCurlEpollDispatcher::unwatch(int fd)
+{
+#ifdef Q_OS_LINUX
+    if (sockets.remove(fd))
+        ::epoll_ctl(epfd, EPOLL_CTL_DEL, fd, 0);
+#else
+    Q_UNUSED(fd);
+#endif
+}
+
+void QCurlEpollDispatcher::dispatch()
+{
+#ifdef Q_OS_LINUX
+    struct epoll_event events[64];
+    int n;
+    do {
+        n = ::epoll_wait(epfd, events, 64, 0);
+    } while (n == -1 && errno == EINTR);
+
+    for (int i = 0; i < n; ++i) {
+        // a socket handled before may have closed or deleted this one
+        QCurlEpollSocket *socket = sockets.value(events[i].data.fd);
+        if (socket)
+            socket->handleEvents(events[i].events);
+    }
+#endif
+}
+
+/****************************************************
+ *
+ * QCurlEpollSocket
+ *
+ ****************************************************/
+
+/*!
+    \class QCurlEpollSocket
+    \brief The QCurlEpollSocket class is a TCP transport for QCurl that
+    drives its socket with epoll directly.
+
+    \inmodule QtNetwork
+
+    A QTcpSocket reads everything that arrives into a buffer of its own,
+    from which QCurl copies it again, and reports every readiness event
+    through its own notifiers. A QCurlEpollSocket leaves received data in
+    the kernel until QCurl reads it, so that it is received straight
+    into QCurl's read buffer, and all the sockets of a thread share one
+    epoll instance, which the event loop watches through a single
+    QSocketNotifier. This pays off when a thread runs many connections at
+    once, as a crawler does.
+
+    It is used in place of the QTcpSocket of a QCurl object:
+
+    \code
+    QCurl curl(QLatin1String("example.com"));
+    if (QCurlEpollSocket::isSupported())
+        curl.setSocket(new QCurlEpollSocket(&curl));
+    \endcode
+
+    The socket is edge-triggered: readyRead() is emitted when new data
+    arrives, and data that is not read stays in the kernel, where it
+    holds back the sender like a full read buffer would. Only plain HTTP
+    is supported (no TLS or proxies), and only on Linux; elsewhere,
+    connecting fails with UnsupportedSocketOperationError.
+
+    \sa QCurl::setSocket()
+*/
+
+/*!
+    Constructs an unconnected socket with the parent \a parent.
+*/
+QCurlEpollSocket::QCurlEpollSocket(QObject *parent)
+    : QTcpSocket(parent), d(new QCurlEpollSocketPrivate)
+{
+}
+
+/*!
+    Destroys the socket, closing the connection without emitting any
+    signal.
+*/
+QCurlEpollSocket::~QCurlEpollSocket()
+{
+    if (d->lookupId != -1)
+        QHostInfo::abortHostLookup(d->lookupId);
+    releaseDescriptor();
+    setSocketState(UnconnectedState);
+}
+
+/*!
+    Returns true if the socket can be used on this platform.
+*/
+bool QCurlEpollSocket::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*!
+    \reimp
+*/
+void QCurlEpollSocket::connectToHost(const QString &hostName, quint16 port, OpenMode mode,
+                                     NetworkLayerProtocol)
+{
+    if (state() != UnconnectedState) {
+        blockSignals(true);
+        close();
+        blockSignals(false);
+    }
+    d->port = port;
+    d->peerClosed = false;
+    setPeerName(hostName);
+    setPeerPort(port);
+    QIODevice::open(mode | QIODevice::Unbuffered);
+
+#ifdef Q_OS_LINUX
+    setSocketState(HostLookupState);
+    QHostAddress address;
+    if (address.setAddress(hostName)) {
+        d->addresses.clear();
+        d->addresses.append(address);
+        emit hostFound();
+        connectNext();
+    } else {
+        d->lookupId = QHostInfo::lookupHost(hostName, this, SLOT(_q_hostFound(QHostInfo)));
+    }
+#else
+    fail(UnsupportedSocketOperationError,
+         QLatin1String(QT_TRANSLATE_NOOP("QCurlEpollSocket", "Operation on socket is not supported")));
+#endif
+}
+
+void QCurlEpollSocket::_q_hostFound(const QHostInfo &info)
+{
+    d->lookupId = -1;
+    if (state() != HostLookupState)
+        return;
+    if (info.error() != QHostInfo::NoError || info.addresses().isEmpty()) {
+        fail(HostNotFoundError, info.error() != QHostInfo::NoError ? info.errorString()
+             : QLatin1String(QT_TRANSLATE_NOOP("QCurlEpollSocket", "Host not found")));
+        return;
+    }
+    d->addresses = info.addresses();
+    emit hostFound();
+    if (state() == HostLookupState)
+        connectNext();
+}
+
+// starts connecting to the next address that does not fail right away
+void QCurlEpollSocket::connectNext()
+{
+#ifdef Q_OS_LINUX
+    int lastError = ECONNREFUSED;
+    while (!d->addresses.isEmpty()) {
+        QHostAddress address = d->addresses.takeFirst();
+
+        struct sockaddr_storage storage;
+        ::memset(&storage, 0, sizeof(storage));
+        socklen_t length;
+        if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+            struct sockaddr_in6 *sa = reinterpret_cast<struct sockaddr_in6 *>(&storage);
+            Q_IPV6ADDR ip6 = address.toIPv6Address();
+            sa->sin6_family = AF_INET6;
+            sa->sin6_port = htons(d->port);
+            ::memcpy(&sa->sin6_addr, &ip6, sizeof(ip6));
+            length = sizeof(*sa);
+        } else if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+            struct sockaddr_in *sa = reinterpret_cast<struct sockaddr_in *>(&storage);
+            sa->sin_family = AF_INET;
+            sa->sin_port = htons(d->port);
+            sa->sin_addr.s_addr = htonl(address.toIPv4Address());
+            length = sizeof(*sa);
+        } else {
+            continue;
+        }
+
+        int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            lastError = errno;
+            continue;
+        }
+        // all of them before connecting, buffer sizes and Fast Open
+        // included (see QCurl::setSocketOption())
+        int options[QCurlSocketOptionCount];
+        qt_curl_socketOptions(this, options);
+        qt_curl_applySocketOptions(fd, options, true);
+        d->quickAck = options[QCurl::QuickAckOption] > 0;
+
+        int result;
+        do {
+            result = ::connect(fd, reinterpret_cast<struct sockaddr *>(&storage), length);
+        } while (result == -1 && errno == EINTR);
+        if (result == -1 && errno != EINPROGRESS) {
+            lastError = errno;
+            ::close(fd);
+            continue;
+        }
+
+        quint32 events = result == 0 ? QCurlEpollReadEvents : quint32(EPOLLOUT);
+        QCurlEpollDispatcher *dispatcher = QCurlEpollDispatcher::instance();
+        if (!dispatcher->watch(fd, this, events)) {
+            lastError = errno;
+            ::close(fd);
+            continue;
+        }
+        d->dispatcher = dispatcher;
+        d->fd = fd;
+        d->watched = events;
+        setPeerAddress(address);
+        if (result == 0) {
+            setSocketState(ConnectedState);
+            emit connected();
+        } else {
+            setSocketState(ConnectingState);
+        }
+        return;
+    }
+    fail(lastError == ENETUNREACH ? NetworkError : ConnectionRefusedError, qt_error_string(lastError));
+#endif
+}
+
+// called by the dispatcher, and by the wait functions with what poll() saw
+void QCurlEpollSocket::handleEvents(quint32 events)
+{
+#ifdef Q_OS_LINUX
+    if (state() == ConnectingState) {
+        int err = 0;
+        socklen_t length = sizeof(err);
+        if (::getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &length) == -1)
+            err = errno;
+        if (err == EINPROGRESS || err == EALREADY || !(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            return;
+        if (err) {
+            releaseDescriptor();
+            if (d->addresses.isEmpty())
+                fail(err == ENETUNREACH ? NetworkError : ConnectionRefusedError, qt_error_string(err));
+            else
+                connectNext();
+            return;
+        }
+        if (d->dispatcher)
+            d->dispatcher->modify(d->fd, QCurlEpollReadEvents);
+        d->watched = QCurlEpollReadEvents;
+        setSocketState(ConnectedState);
+        emit connected();
+        return;
+    }
+    if (state() != ConnectedState)
+        return;
+
+    if (events & EPOLLERR) {
+        int err = 0;
+        socklen_t length = sizeof(err);
+        ::getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &length);
+        if (err) {
+            fail(err == ECONNRESET ? RemoteHostClosedError : NetworkError, qt_error_string(err));
+            return;
+        }
+    }
+    if (events & (EPOLLRDHUP | EPOLLHUP))
+        d->peerClosed = true;
+    if ((events & EPOLLOUT) && !flushWrites())
+        return;
+    if ((events & EPOLLIN) && bytesAvailable() > 0) {
+        emit readyRead();
+        if (state() != ConnectedState)
+            return;
+    }
+    if (d->peerClosed && bytesAvailable() == 0)
+        _q_hangUp();
+#else
+    Q_UNUSED(events);
+#endif
+}
+
+/*
+    Hands what is left of the written data to the kernel and, once all
+    of it is there, reports it with bytesWritten(). Returns false if the
+    socket failed.
+*/
+bool QCurlEpollSocket::flushWrites()
+{
+#ifdef Q_OS_LINUX
+    while (!d->writeBuffer.isEmpty()) {
+        ssize_t n = ::send(d->fd, d->writeBuffer.constData(), d->writeBuffer.size(), MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS))
+            return true;    // the next EPOLLOUT edge brings us back
+        if (n == -1) {
+            int err = errno;
+            fail(err == EPIPE || err == ECONNRESET ? RemoteHostClosedError : NetworkError, qt_error_string(err));
+            return false;
+        }
+        d->writeBuffer.remove(0, int(n));
+    }
+    if (d->watched != QCurlEpollReadEvents) {
+        if (d->dispatcher)
+            d->dispatcher->modify(d->fd, QCurlEpollReadEvents);
+        d->watched = QCurlEpollReadEvents;
+    }
+    if (d->written > 0) {
+        qint64 n = d->written;
+        d->written = 0;
+        emit bytesWritten(n);
+    }
+    return state() == ConnectedState;
+#else
+    return false;
+#endif
+}
+
+void QCurlEpollSocket::fail(QAbstractSocket::SocketError socketError, const QString &message)
+{
+    releaseDescriptor();
+    d->addresses.clear();
+    setSocketState(UnconnectedState);
+    setSocketError(socketError);
+    setErrorString(message);
+    emit error(socketError);
+}
+
+void QCurlEpollSocket::releaseDescriptor()
+{
+#ifdef Q_OS_LINUX
+    if (d->fd != -1) {
+        if (d->dispatcher)
+            d->dispatcher->unwatch(d->fd);
+        ::close(d->fd);
+        d->fd = -1;
+    }
+#endif
+    d->watched = 0;
+    d->writeBuffer.clear();
+    d->written = 0;
+    d->peekBuffer.clear();
+    d->lineLength = 0;
+    d->lineScanned = 0;
+}
+
+// the peer closed its side and everything it sent was read
+void QCurlEpollSocket::_q_hangUp()
+{
+    d->hangUpScheduled = false;
+    // a call scheduled for a connection that was replaced meanwhile
+    if (state() != ConnectedState || !d->peerClosed || bytesAvailable() > 0)
+        return;
+    releaseDescriptor();
+    setSocketState(UnconnectedState);
+    emit readChannelFinished();
+    emit disconnected();
+}
+
+/*! \reimp
+*/
+void QCurlEpollSocket::disconnectFromHost()
+{
+    close();
+}
+
+/*! \reimp
+*/
+void QCurlEpollSocket::close()
+{
+    bool wasConnected = state() == ConnectedState;
+    if (d->lookupId != -1) {
+        QHostInfo::abortHostLookup(d->lookupId);
+        d->lookupId = -1;
+    }
+    releaseDescriptor();
+    d->addresses.clear();
+    QIODevice::close();
+    setSocketState(UnconnectedState);
+    if (wasConnected)
+        emit disconnected();
+}
+
+/*!
+    \reimp
+
+    Returns the number of bytes waiting in the kernel.
+*/
+qint64 QCurlEpollSocket::bytesAvailable() const
+{
+#ifdef Q_OS_LINUX
+    int n = 0;
+    if (d->fd != -1 && ::ioctl(d->fd, FIONREAD, &n) == 0)
+        return n;
+#endif
+    return 0;
+}
+
+/*!
+    \reimp
+
+    Returns the number of written bytes not reported with bytesWritten()
+    yet.
+*/
+qint64 QCurlEpollSocket::bytesToWrite() const
+{
+    return d->written;
+}
+
+/*! \reimp
+*/
+bool QCurlEpollSocket::canReadLine() const
+{
+    return peekLine(64 * 1024) > 0;
+}
+
+/*
+    Returns the length of the next line, newline included, if it ends
+    within the first \a limit bytes waiting in the kernel, and 0
+    otherwise. The kernel is peeked at in growing steps, as header and
+    chunk size lines are short, and what was found is kept until it is
+    read, so that canReadLine() and readLine() do not peek again.
+*/
+qint64 QCurlEpollSocket::peekLine(qint64 limit) const
+{
+#ifdef Q_OS_LINUX
+    if (d->lineLength > 0)
+        return d->lineLength <= limit ? d->lineLength : 0;
+    if (d->fd == -1)
+        return 0;
+    qint64 available = qMin(bytesAvailable(), limit);
+    qint64 step = qMax<qint64>(256, d->lineScanned * 2);
+    while (d->lineScanned < available) {
+        qint64 size = qMin(step, available);
+        d->peekBuffer.resize(int(size));
+        ssize_t n = ::recv(d->fd, d->peekBuffer.data(), size_t(size), MSG_PEEK | MSG_DONTWAIT);
+        if (n <= d->lineScanned)
+            break;
+        const char *begin = d->peekBuffer.constData();
+        const char *end = static_cast<const char *>(
+            ::memchr(begin + d->lineScanned, '\n', size_t(n - d->lineScanned)));
+        if (end) {
+            d->lineLength = end - begin + 1;
+            return d->lineLength;
+        }
+        d->lineScanned = n;
+        step *= 2;
+    }
+#else
+    Q_UNUSED(limit);
+#endif
+    return 0;
+}
+
+#ifdef Q_OS_LINUX
+static bool qt_curl_poll(int fd, short events, int msecs, short *revents)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    int n;
+    do {
+        n = ::poll(&pfd, 1, msecs);
+    } while (n == -1 && errno == EINTR);
+    *revents = pfd.revents;
+    return n > 0;
+}
+
+static quint32 qt_curl_epollEvents(short revents)
+{
+    quint32 events = 0;
+    if (revents & POLLIN)
+        events |= EPOLLIN;
+    if (revents & POLLOUT)
+        events |= EPOLLOUT;
+    if (revents & POLLRDHUP)
+        events |= EPOLLRDHUP;
+    if (revents & POLLHUP)
+        events |= EPOLLHUP;
+    if (revents & POLLERR)
+        events |= EPOLLERR;
+    return events;
+}
+#endif
+
+/*!
+    \reimp
+
+    Looks up the host with QHostInfo::fromName() if the lookup is still
+    running, then waits for the connection with poll().
+*/
+bool QCurlEpollSocket::waitForConnected(int msecs)
+{
+#ifdef Q_OS_LINUX
+    if (state() == HostLookupState) {
+        if (d->lookupId != -1) {
+            QHostInfo::abortHostLookup(d->lookupId);
+            d->lookupId = -1;
+        }
+        _q_hostFound(QHostInfo::fromName(peerName()));
+    }
+    while (state() == ConnectingState) {
+        short revents;
+        if (!qt_curl_poll(d->fd, POLLOUT, msecs, &revents))
+            break;
+        handleEvents(qt_curl_epollEvents(revents));
+    }
+#else
+    Q_UNUSED(msecs);
+#endif
+    return state() == ConnectedState;
+}
+
+/*! \reimp
+*/
+bool QCurlEpollSocket::waitForReadyRead(int msecs)
+{
+#ifdef Q_OS_LINUX
+    if (state() != ConnectedState)
+        return false;
+    if (d->peerClosed && bytesAvailable() == 0) {
+        // there is no event loop to run the scheduled call
+        _q_hangUp();
+        return true;
+    }
+    if (!d->writeBuffer.isEmpty() || d->written > 0) {
+        if (!waitForBytesWritten(msecs))
+            return false;
+    }
+    short revents;
+    if (!qt_curl_poll(d->fd, POLLIN | POLLRDHUP, msecs, &revents))
+        return false;
+    handleEvents(qt_curl_epollEvents(revents));
+    return true;
+#else
+    Q_UNUSED(msecs);
+    return false;
+#endif
+}
+
+/*! \reimp
+*/
+bool QCurlEpollSocket::waitForBytesWritten(int msecs)
+{
+#ifdef Q_OS_LINUX
+    if (state() != ConnectedState || (d->writeBuffer.isEmpty() && d->written == 0))
+        return false;
+    while (!d->writeBuffer.isEmpty()) {
+        short revents;
+        if (!qt_curl_poll(d->fd, POLLOUT, msecs, &revents))
+            return false;
+        if (revents & (POLLERR | POLLHUP)) {
+            handleEvents(qt_curl_epollEvents(revents));
+            return false;
+        }
+        if (!flushWrites())
+            return false;
+    }
+    return flushWrites();
+#else
+    Q_UNUSED(msecs);
+    return false;
+#endif
+}
+
+/*! \reimp
+*/
+bool QCurlEpollSocket::waitForDisconnected(int msecs)
+{
+    Q_UNUSED(msecs);
+    return state() == UnconnectedState;
+}
+
+/*!
+    \reimp
+
+    Applies the socket options that QCurl publishes again when they
+    change to the open socket, which QCurl cannot reach through
+    socketDescriptor().
+*/
+bool QCurlEpollSocket::event(QEvent *event)
+{
+#ifdef Q_OS_LINUX
+    if (event->type() == QEvent::DynamicPropertyChange && d->fd != -1
+        && static_cast<QDynamicPropertyChangeEvent *>(event)->propertyName() == QCURL_SOCKET_OPTIONS_PROPERTY) {
+        int options[QCurlSocketOptionCount];
+        qt_curl_socketOptions(this, options);
+        for (int i = 0; i < QCurlSocketOptionCount; ++i) {
+            if (options[i] < 0)
+                qt_curl_resetSocketOption(d->fd, i);
+        }
+        qt_curl_applySocketOptions(d->fd, options, false);
+        d->quickAck = options[QCurl::QuickAckOption] > 0;
+    }
+#endif
+    return QTcpSocket::event(event);
+}
+
+/*!
+    \reimp
+
+    Receives straight into \a data, without copying through a buffer of
+    the socket.
+*/
+qint64 QCurlEpollSocket::readData(char *data, qint64 maxSize)
+{
+#ifdef Q_OS_LINUX
+    if (d->fd == -1)
+        return -1;
+    ssize_t n;
+    do {
+        n = ::recv(d->fd, data, size_t(maxSize), MSG_DONTWAIT);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        setSocketError(NetworkError);
+        setErrorString(qt_error_string(errno));
+        return -1;
+    }
+    if (n > 0) {
+        if (d->quickAck)
+            qt_curl_renewQuickAck(d->fd);
+        // the line found by peekLine() moves up
+        d->lineLength = qMax<qint64>(0, d->lineLength - n);
+        d->lineScanned = d->lineLength > 0 ? 0 : qMax<qint64>(0, d->lineScanned - n);
+    }
+    if (n == 0)
+        d->peerClosed = true;
+    // the close was only seen once; report it when the last byte is
+    // read, from the event loop rather than from within read()
+    if (d->peerClosed && !d->hangUpScheduled && bytesAvailable() == 0) {
+        d->hangUpScheduled = true;
+        QMetaObject::invokeMethod(this, "_q_hangUp", Qt::QueuedConnection);
+    }
+    return qMax<ssize_t>(0, n);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+#endif
+}
+
+/*! \reimp
+*/
+qint64 QCurlEpollSocket::readLineData(char *data, qint64 maxSize)
+{
+#ifdef Q_OS_LINUX
+    if (d->fd == -1)
+        return -1;
+    // take no more than the line, usually found by canReadLine() already
+    qint64 length = peekLine(maxSize);
+    return readData(data, length > 0 ? length : maxSize);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+#endif
+}
+
+/*!
+    \reimp
+
+    Hands \a data to the kernel right away and keeps what it did not
+    take; bytesWritten() is emitted once all of it was taken.
+*/
+qint64 QCurlEpollSocket::writeData(const char *data, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    if (state() != ConnectedState) {
+        setSocketError(NetworkError);
+        setErrorString(QLatin1String(QT_TRANSLATE_NOOP("QCurlEpollSocket", "Socket is not connected")));
+        return -1;
+    }
+    qint64 sent = 0;
+    if (d->writeBuffer.isEmpty()) {
+        ssize_t n;
+        do {
+            n = ::send(d->fd, data, size_t(size), MSG_NOSIGNAL | MSG_DONTWAIT);
+        } while (n == -1 && errno == EINTR);
+        // EINPROGRESS: a Fast Open connection still waits for the handshake
+        if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINPROGRESS) {
+            setSocketError(errno == EPIPE || errno == ECONNRESET ? RemoteHostClosedError : NetworkError);
+            setErrorString(qt_error_string(errno));
+            return -1;
+        }
+        sent = qMax<ssize_t>(0, n);
+    }
+    if (sent < size)
+        d->writeBuffer.append(data + sent, int(size - sent));
+    d->written += size;
+
+    // bytesWritten() comes from the event loop, when epoll reports the
+    // socket writable
+    if (!(d->watched & EPOLLOUT)) {
+        d->watched = QCurlEpollReadEvents | EPOLLOUT;
+        if (d->dispatcher)
+            d->dispatcher->modify(d->fd, d->watched);
+    }
+    return size;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return -1;
+#endif
+}
+
+QT_END_NAMESPACE
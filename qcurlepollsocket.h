@@ -0,0 +1,63 @@
+#ifndef QCURLEPOLLSOCKET_H
+#define QCURLEPOLLSOCKET_H
+
+#include "qcurl_global.h"
+#include <QtCore/qscopedpointer.h>
+#include <QtNetwork/qtcpsocket.h>
+
+QT_BEGIN_HEADER
+
+class QHostInfo;
+class QCurlEpollSocketPrivate;
+
+class QCURLSHARED_EXPORT QCurlEpollSocket : public QTcpSocket
+{
+    Q_OBJECT
+
+public:
+    explicit QCurlEpollSocket(QObject *parent = 0);
+    ~QCurlEpollSocket();
+
+    static bool isSupported();
+
+    void connectToHost(const QString &hostName, quint16 port, OpenMode mode = ReadWrite,
+                       NetworkLayerProtocol protocol = AnyIPProtocol);
+    void disconnectFromHost();
+    void close();
+
+    qint64 bytesAvailable() const;
+    qint64 bytesToWrite() const;
+    bool canReadLine() const;
+
+    bool waitForConnected(int msecs = 30000);
+    bool waitForReadyRead(int msecs = 30000);
+    bool waitForBytesWritten(int msecs = 30000);
+    bool waitForDisconnected(int msecs = 30000);
+
+protected:
+    bool event(QEvent *event);
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 readLineData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 size);
+
+private Q_SLOTS:
+    void _q_hostFound(const QHostInfo &info);
+    void _q_hangUp();
+
+private:
+    Q_DISABLE_COPY(QCurlEpollSocket)
+    QScopedPointer<QCurlEpollSocketPrivate> d;
+
+    void connectNext();
+    void handleEvents(quint32 events);
+    bool flushWrites();
+    qint64 peekLine(qint64 limit) const;
+    void fail(QAbstractSocket::SocketError socketError, const QString &message);
+    void releaseDescriptor();
+
+    friend class QCurlEpollDispatcher;
+};
+
+QT_END_HEADER
+
+#endif // QCURLEPOLLSOCKET_H
@@ -0,0 +1,127 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCURLEPOLLSOCKET_P_H
+#define QCURLEPOLLSOCKET_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qcurlepollsocket.h"
+
+#include <qbytearray.h>
+#include <qhash.h>
+#include <qhostaddress.h>
+#include <qlist.h>
+#include <qobject.h>
+
+QT_BEGIN_NAMESPACE
+
+class QSocketNotifier;
+
+/*
+    One epoll instance per thread for all the QCurlEpollSocket objects
+    living in it. The event loop only watches the epoll descriptor,
+    through a single QSocketNotifier; when it fires, the ready sockets
+    are handled in one go.
+*/
+class QCurlEpollDispatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    QCurlEpollDispatcher();
+    ~QCurlEpollDispatcher();
+
+    static QCurlEpollDispatcher *instance();
+
+    bool watch(int fd, QCurlEpollSocket *socket, quint32 events);
+    bool modify(int fd, quint32 events);
+    void unwatch(int fd);
+
+private Q_SLOTS:
+    void dispatch();
+
+private:
+    int epfd;
+    QSocketNotifier *notifier;
+    QHash<int, QCurlEpollSocket *> sockets;
+};
+
+class QCurlEpollSocketPrivate
+{
+public:
+    QCurlEpollSocketPrivate()
+        : fd(-1), dispatcher(0), port(0), lookupId(-1), watched(0),
+          written(0), peerClosed(false), hangUpScheduled(false), quickAck(false),
+          lineLength(0), lineScanned(0)
+    { }
+
+    int fd;
+    QCurlEpollDispatcher *dispatcher;   // the one fd is registered with, 0 once it is gone
+    quint16 port;
+    int lookupId;
+    QList<QHostAddress> addresses;  // still to try
+    quint32 watched;                // the events registered for fd
+
+    QByteArray writeBuffer;         // what the kernel did not take yet
+    qint64 written;                 // bytesWritten() not emitted for it yet
+    bool peerClosed;
+    bool hangUpScheduled;
+    bool quickAck;              // renewed after every read
+    // what peeking for the next line found, kept until it is read:
+    // its length with the newline, or 0 with the bytes known to hold none
+    QByteArray peekBuffer;
+    qint64 lineLength;
+    qint64 lineScanned;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCURLEPOLLSOCKET_P_H
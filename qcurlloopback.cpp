@@ -0,0 +1,484 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+#include "qcurlloopback.h"
+
+#include "qlist.h"
+
+#include <string.h>
+
+QT_BEGIN_NAMESPACE
+
+class QCurlLoopbackSocketPrivate
+{
+public:
+    QCurlLoopbackSocketPrivate()
+        : next(0), repeat(false), chunkSize(0), served(0), requestBytes(0),
+          readPos(0), responsePos(0), written(0), deliveries(0),
+          bodyLeft(0), waiting(0), deliveryScheduled(false)
+    { }
+
+    void reset();
+    void takeRequest(const char *data, qint64 size);
+
+    QList<QByteArray> responses;
+    int next;                   // the response for the next request
+    bool repeat;
+    int chunkSize;
+    int served;
+    qint64 requestBytes;
+
+    QByteArray incoming;        // delivered to the client, not read yet
+    int readPos;
+    QByteArray response;        // the response being delivered
+    int responsePos;
+    qint64 written;             // bytesWritten() not emitted for it yet
+    quint64 deliveries;
+
+    // what the server knows of the request: its header up to the empty
+    // line, then as many bytes as its content-length said
+    QByteArray header;
+    qint64 bodyLeft;
+    int waiting;                // complete requests without a response yet
+    bool deliveryScheduled;
+};
+
+void QCurlLoopbackSocketPrivate::reset()
+{
+    incoming.clear();
+    readPos = 0;
+    response.clear();
+    responsePos = 0;
+    written = 0;
+    header.clear();
+    bodyLeft = 0;
+    waiting = 0;
+}
+
+void QCurlLoopbackSocketPrivate::takeRequest(const char *data, qint64 size)
+{
+    requestBytes += size;
+    while (size > 0) {
+        if (bodyLeft > 0) {
+            qint64 n = qMin(bodyLeft, size);
+            bodyLeft -= n;
+            data += n;
+            size -= n;
+            if (bodyLeft == 0)
+                ++waiting;
+            continue;
+        }
+
+        int from = qMax(0, header.size() - 3);
+        header.append(data, int(size));
+        int end = header.indexOf("\r\n\r\n", from);
+        if (end == -1)
+            return;
+
+        // the rest of what was written belongs to the body
+        qint64 used = end + 4 - (header.size() - size);
+        data += used;
+        size -= used;
+
+        QList<QByteArray> lines = header.left(end).split('\n');
+        for (int i = 1; i < lines.count(); ++i) {
+            const QByteArray &line = lines.at(i);
+            int colon = line.indexOf(':');
+            if (colon != -1 && line.left(colon).trimmed().toLower() == "content-length")
+                bodyLeft = line.mid(colon + 1).trimmed().toLongLong();
+        }
+        header.clear();
+        if (bodyLeft <= 0) {
+            bodyLeft = 0;
+            ++waiting;
+        }
+    }
+}
+
+/*!
+    \class QCurlLoopbackSocket
+    \brief The QCurlLoopbackSocket class is an in-memory transport that
+    answers requests with canned responses.
+
+    \inmodule QtNetwork
+
+    A QCurlLoopbackSocket takes the place of the QTcpSocket of a QCurl
+    object (see QCurl::setSocket()) without any network behind it:
+    connecting succeeds right away, what QCurl writes is only looked at
+    to tell where each request ends, and every request is answered with
+    the next of the responses added with addResponse(), byte for byte as
+    given. This makes runs deterministic and takes the kernel out of the
+    picture, which is what benchmarks and profiles of the response
+    parsing, header handling and buffering of QCurl need.
+
+    \code
+    QCurlLoopbackSocket server;
+    server.addResponse("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+    server.setRepeat(true);
+
+    QCurl curl(QLatin1String("example.com"));
+    curl.setSocket(&server);
+    for (int i = 0; i < 100000; ++i)
+        curl.get(QLatin1String("/"));
+    \endcode
+
+    Responses are delivered from the event loop, in one piece or in
+    pieces of chunkSize() bytes, as fast as QCurl reads them. Once the
+    last response was delivered and repeat() is off, the server side
+    closes the connection, which ends responses delimited by the close
+    and fails the requests that come after.
+
+    \sa QCurl::setSocket()
+*/
+
+/*!
+    Constructs an unconnected loopback socket with the parent \a parent
+    and no responses.
+*/
+QCurlLoopbackSocket::QCurlLoopbackSocket(QObject *parent)
+    : QTcpSocket(parent), d(new QCurlLoopbackSocketPrivate)
+{
+}
+
+/*!
+    Destroys the socket.
+*/
+QCurlLoopbackSocket::~QCurlLoopbackSocket()
+{
+    // QAbstractSocket would close it without knowing there is no engine
+    setSocketState(UnconnectedState);
+}
+
+/*!
+    Adds \a response to the responses, which are used in the order they
+    were added. It is sent as it is and has to be a complete HTTP
+    response, status line and header included.
+
+    \sa clearResponses() setRepeat()
+*/
+void QCurlLoopbackSocket::addResponse(const QByteArray &response)
+{
+    d->responses.append(response);
+}
+
+/*!
+    Removes all responses; the next one added answers the next request.
+*/
+void QCurlLoopbackSocket::clearResponses()
+{
+    d->responses.clear();
+    d->next = 0;
+}
+
+/*!
+    If \a repeat is true, the responses are used over again once all of
+    them were sent, instead of closing the connection. The default is
+    false.
+*/
+void QCurlLoopbackSocket::setRepeat(bool repeat)
+{
+    d->repeat = repeat;
+    if (repeat && d->next >= d->responses.count())
+        d->next = 0;
+}
+
+/*!
+    Returns true if the responses are used over again.
+
+    \sa setRepeat()
+*/
+bool QCurlLoopbackSocket::repeat() const
+{
+    return d->repeat;
+}
+
+/*!
+    Delivers the responses in pieces of at most \a bytes bytes, one per
+    readyRead() signal, the way they trickle in from a network. With 0,
+    the default, each response is delivered in one piece.
+*/
+void QCurlLoopbackSocket::setChunkSize(int bytes)
+{
+    d->chunkSize = qMax(0, bytes);
+}
+
+/*!
+    Returns the size of the pieces responses are delivered in, or 0 if
+    they are delivered whole.
+
+    \sa setChunkSize()
+*/
+int QCurlLoopbackSocket::chunkSize() const
+{
+    return d->chunkSize;
+}
+
+/*!
+    Returns the number of requests answered so far.
+*/
+int QCurlLoopbackSocket::requestsServed() const
+{
+    return d->served;
+}
+
+/*!
+    Returns the number of bytes written to the socket so far, request
+    headers and bodies together.
+*/
+qint64 QCurlLoopbackSocket::requestBytes() const
+{
+    return d->requestBytes;
+}
+
+/*!
+    \reimp
+
+    Connects right away; \a hostName and \a port are only recorded as the
+    peer. The hostFound() and connected() signals are emitted before the
+    function returns.
+*/
+void QCurlLoopbackSocket::connectToHost(const QString &hostName, quint16 port, OpenMode mode,
+                                        NetworkLayerProtocol)
+{
+    d->reset();
+    if (isOpen())
+        QIODevice::close();
+    QIODevice::open(mode | QIODevice::Unbuffered);
+    setPeerName(hostName);
+    setPeerPort(port);
+    setSocketState(ConnectedState);
+    emit hostFound();
+    emit connected();
+}
+
+/*! \reimp
+*/
+void QCurlLoopbackSocket::disconnectFromHost()
+{
+    close();
+}
+
+/*! \reimp
+*/
+void QCurlLoopbackSocket::close()
+{
+    bool wasConnected = state() == ConnectedState;
+    d->reset();
+    QIODevice::close();
+    setSocketState(UnconnectedState);
+    if (wasConnected)
+        emit disconnected();
+}
+
+/*! \reimp
+*/
+qint64 QCurlLoopbackSocket::bytesAvailable() const
+{
+    return d->incoming.size() - d->readPos;
+}
+
+/*! \reimp
+*/
+qint64 QCurlLoopbackSocket::bytesToWrite() const
+{
+    return d->written;
+}
+
+/*! \reimp
+*/
+bool QCurlLoopbackSocket::canReadLine() const
+{
+    return d->incoming.indexOf('\n', d->readPos) != -1;
+}
+
+/*! \reimp
+*/
+bool QCurlLoopbackSocket::waitForConnected(int)
+{
+    return state() == ConnectedState;
+}
+
+/*!
+    \reimp
+
+    Delivers what would come next right away; returns false if nothing
+    would.
+*/
+bool QCurlLoopbackSocket::waitForReadyRead(int)
+{
+    if (state() != ConnectedState)
+        return false;
+    quint64 before = d->deliveries;
+    if (d->written > 0) {
+        qint64 n = d->written;
+        d->written = 0;
+        emit bytesWritten(n);
+    }
+    if (state() == ConnectedState && deliver())
+        scheduleDelivery();
+    return d->deliveries != before;
+}
+
+/*! \reimp
+*/
+bool QCurlLoopbackSocket::waitForBytesWritten(int)
+{
+    if (state() != ConnectedState || d->written == 0)
+        return false;
+    qint64 n = d->written;
+    d->written = 0;
+    emit bytesWritten(n);
+    return true;
+}
+
+/*! \reimp
+*/
+bool QCurlLoopbackSocket::waitForDisconnected(int)
+{
+    return state() == UnconnectedState;
+}
+
+/*! \reimp
+*/
+qint64 QCurlLoopbackSocket::readData(char *data, qint64 maxSize)
+{
+    qint64 n = qMin(maxSize, bytesAvailable());
+    if (n <= 0)
+        return state() == ConnectedState ? 0 : -1;
+    ::memcpy(data, d->incoming.constData() + d->readPos, size_t(n));
+    d->readPos += int(n);
+    if (d->readPos == d->incoming.size()) {
+        d->incoming.clear();
+        d->readPos = 0;
+    }
+    return n;
+}
+
+/*! \reimp
+*/
+qint64 QCurlLoopbackSocket::readLineData(char *data, qint64 maxSize)
+{
+    int end = d->incoming.indexOf('\n', d->readPos);
+    qint64 n = end == -1 ? bytesAvailable() : end - d->readPos + 1;
+    return readData(data, qMin(n, maxSize));
+}
+
+/*! \reimp
+*/
+qint64 QCurlLoopbackSocket::writeData(const char *data, qint64 size)
+{
+    if (state() != ConnectedState) {
+        setSocketError(NetworkError);
+        setErrorString(QLatin1String(QT_TRANSLATE_NOOP("QCurlLoopbackSocket", "Socket is not connected")));
+        return -1;
+    }
+    d->takeRequest(data, size);
+    d->written += size;
+    scheduleDelivery();
+    return size;
+}
+
+void QCurlLoopbackSocket::scheduleDelivery()
+{
+    if (d->deliveryScheduled)
+        return;
+    d->deliveryScheduled = true;
+    QMetaObject::invokeMethod(this, "_q_deliver", Qt::QueuedConnection);
+}
+
+void QCurlLoopbackSocket::_q_deliver()
+{
+    d->deliveryScheduled = false;
+    if (state() != ConnectedState)
+        return;
+    if (d->written > 0) {
+        qint64 n = d->written;
+        d->written = 0;
+        emit bytesWritten(n);
+    }
+    if (state() == ConnectedState && deliver())
+        scheduleDelivery();
+}
+
+/*
+    Delivers the next piece of the response to the oldest unanswered
+    request and returns true if there is more to do after it; hangs up
+    once there is nothing left to answer with.
+*/
+bool QCurlLoopbackSocket::deliver()
+{
+    if (d->responsePos == d->response.size()) {
+        d->response.clear();
+        d->responsePos = 0;
+        if (d->next >= d->responses.count()) {
+            // out of responses: the server closes the connection, what
+            // was delivered can still be read
+            d->waiting = 0;
+            d->header.clear();
+            d->bodyLeft = 0;
+            setSocketState(UnconnectedState);
+            emit readChannelFinished();
+            emit disconnected();
+            return false;
+        }
+        if (d->waiting == 0)
+            return false;
+        --d->waiting;
+        d->response = d->responses.at(d->next++);
+        ++d->served;
+        if (d->repeat && d->next == d->responses.count())
+            d->next = 0;
+    }
+
+    int n = d->response.size() - d->responsePos;
+    if (d->chunkSize > 0 && n > d->chunkSize)
+        n = d->chunkSize;
+    if (d->incoming.isEmpty() && d->responsePos == 0 && n == d->response.size())
+        d->incoming = d->response;      // shared, not copied
+    else
+        d->incoming.append(d->response.constData() + d->responsePos, n);
+    d->responsePos += n;
+    ++d->deliveries;
+    emit readyRead();
+
+    return d->responsePos < d->response.size() || d->waiting > 0
+        || d->next >= d->responses.count();
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,63 @@
+#ifndef QCURLLOOPBACK_H
+#define QCURLLOOPBACK_H
+
+#include "qcurl_global.h"
+#include <QtCore/qscopedpointer.h>
+#include <QtNetwork/qtcpsocket.h>
+
+QT_BEGIN_HEADER
+
+class QCurlLoopbackSocketPrivate;
+
+class QCURLSHARED_EXPORT QCurlLoopbackSocket : public QTcpSocket
+{
+    Q_OBJECT
+
+public:
+    explicit QCurlLoopbackSocket(QObject *parent = 0);
+    ~QCurlLoopbackSocket();
+
+    void addResponse(const QByteArray &response);
+    void clearResponses();
+
+    void setRepeat(bool repeat);
+    bool repeat() const;
+    void setChunkSize(int bytes);
+    int chunkSize() const;
+
+    int requestsServed() const;
+    qint64 requestBytes() const;
+
+    void connectToHost(const QString &hostName, quint16 port, OpenMode mode = ReadWrite,
+                       NetworkLayerProtocol protocol = AnyIPProtocol);
+    void disconnectFromHost();
+    void close();
+
+    qint64 bytesAvailable() const;
+    qint64 bytesToWrite() const;
+    bool canReadLine() const;
+
+    bool waitForConnected(int msecs = 30000);
+    bool waitForReadyRead(int msecs = 30000);
+    bool waitForBytesWritten(int msecs = 30000);
+    bool waitForDisconnected(int msecs = 30000);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 readLineData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 size);
+
+private Q_SLOTS:
+    void _q_deliver();
+
+private:
+    Q_DISABLE_COPY(QCurlLoopbackSocket)
+    QScopedPointer<QCurlLoopbackSocketPrivate> d;
+
+    void scheduleDelivery();
+    bool deliver();
+};
+
+QT_END_HEADER
+
+#endif // QCURLLOOPBACK_H
@@ -0,0 +1,215 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCURLRATELIMITER_P_H
+#define QCURLRATELIMITER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <qelapsedtimer.h>
+#include <qhash.h>
+#include <qmath.h>
+#include <qmutex.h>
+#include <qstring.h>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    A token bucket: tokens accumulate at rate per second up to burst, and
+    every unit of work takes one. take() may overdraw the bucket, so that
+    two users racing for the last tokens just wait longer next time.
+*/
+class QCurlTokenBucket
+{
+public:
+    QCurlTokenBucket() : rate(0), burst(0), tokens(0), last(0)
+    { }
+
+    inline bool isLimited() const { return rate > 0; }
+    inline qreal limit() const { return rate; }
+
+    void setRate(qreal perSecond, qreal burstSize)
+    {
+        rate = qMax(qreal(0), perSecond);
+        burst = qMax(qreal(1), burstSize);
+        tokens = burst;
+        clock.start();
+        last = 0;
+    }
+
+    qint64 available()
+    {
+        refill();
+        return tokens > 0 ? qint64(tokens) : 0;
+    }
+
+    void take(qint64 count)
+    {
+        refill();
+        tokens -= count;
+    }
+
+    // Returns the msecs until count tokens (but never more than half a
+    // burst, to keep the wakeups reasonably coarse) are available.
+    int msecsUntil(qint64 count)
+    {
+        refill();
+        qreal missing = qMin(qreal(count), qMax(qreal(1), burst / 2)) - tokens;
+        if (missing <= 0)
+            return 0;
+        return qMax(1, qCeil(missing * 1000 / rate));
+    }
+
+private:
+    void refill()
+    {
+        qint64 now = clock.nsecsElapsed();
+        tokens = qMin(burst, tokens + (now - last) * rate / 1000000000);
+        last = now;
+    }
+
+    qreal rate;
+    qreal burst;
+    qreal tokens;
+    QElapsedTimer clock;
+    qint64 last;
+};
+
+/*
+    The limits of one QCurl object, or the global ones shared by all of
+    them (which is why it is locked): bytes per second in each direction
+    and requests per second per host.
+*/
+class QCurlRateLimiter
+{
+public:
+    enum Direction {
+        Download,
+        Upload
+    };
+
+    void setRate(Direction dir, qint64 bytesPerSecond)
+    {
+        QMutexLocker locker(&mutex);
+        // allow bursts of about 100 ms worth of data
+        bytes[dir].setRate(qreal(bytesPerSecond), qreal(qMax<qint64>(4096, bytesPerSecond / 10)));
+    }
+
+    qint64 rate(Direction dir)
+    {
+        QMutexLocker locker(&mutex);
+        return qint64(bytes[dir].limit());
+    }
+
+    // Returns how many of wanted bytes may be transferred now, or -1 if
+    // there is no limit.
+    qint64 allowance(Direction dir, qint64 wanted)
+    {
+        QMutexLocker locker(&mutex);
+        if (!bytes[dir].isLimited())
+            return -1;
+        return qMin(wanted, bytes[dir].available());
+    }
+
+    int msecsUntil(Direction dir, qint64 wanted)
+    {
+        QMutexLocker locker(&mutex);
+        return bytes[dir].isLimited() ? bytes[dir].msecsUntil(wanted) : 0;
+    }
+
+    void take(Direction dir, qint64 count)
+    {
+        QMutexLocker locker(&mutex);
+        if (bytes[dir].isLimited())
+            bytes[dir].take(count);
+    }
+
+    void setRequestRate(const QString &hostName, qreal perSecond)
+    {
+        QMutexLocker locker(&mutex);
+        if (perSecond <= 0) {
+            requests.remove(hostName.toLower());
+        } else {
+            // no bursts: requests are spaced evenly
+            requests[hostName.toLower()].setRate(perSecond, 1);
+        }
+    }
+
+    qreal requestRate(const QString &hostName)
+    {
+        QMutexLocker locker(&mutex);
+        return requests.value(hostName.toLower()).limit();
+    }
+
+    // Returns the msecs until a request to hostName may be started.
+    int msecsUntilRequest(const QString &hostName)
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QString, QCurlTokenBucket>::Iterator it = requests.find(hostName.toLower());
+        return it == requests.end() ? 0 : it->msecsUntil(1);
+    }
+
+    void takeRequest(const QString &hostName)
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QString, QCurlTokenBucket>::Iterator it = requests.find(hostName.toLower());
+        if (it != requests.end())
+            it->take(1);
+    }
+
+private:
+    QMutex mutex;
+    QCurlTokenBucket bytes[2];
+    QHash<QString, QCurlTokenBucket> requests;
+};
+
+QT_END_NAMESPACE
+
+#endif // QCURLRATELIMITER_P_H
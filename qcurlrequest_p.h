@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCURLREQUEST_P_H
+#define QCURLREQUEST_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#include "qcurl.h"
+
+#include <qbytearray.h>
+#include <qlist.h>
+#include <qpair.h>
+#include <qshareddata.h>
+
+QT_BEGIN_NAMESPACE
+
+/*
+    Per thread free lists for the records every request allocates: the
+    QCurlRequest itself and the private part of its header. Blocks are
+    rounded up to a few size classes, so that a steady stream of
+    requests keeps reusing the same record blocks.
+*/
+class QCURL_AUTOTEST_EXPORT QCurlRecordPool
+{
+public:
+    enum { Granularity = 32, Classes = 16, MaxFree = 64 };
+
+    QCurlRecordPool()
+    {
+        for (int i = 0; i < Classes; ++i) {
+            freeList[i] = 0;
+            freeCount[i] = 0;
+        }
+    }
+    ~QCurlRecordPool();
+
+    static void *allocate(size_t size);
+    static void release(void *p, size_t size);
+
+private:
+    struct Block { Block *next; };
+
+    static QCurlRecordPool *local(bool create);
+
+    Block *freeList[Classes];
+    int freeCount[Classes];
+};
+
+/*
+    The shared part of a QCurlRequestTemplate. The fixed fields are
+    serialized once; serialize() only adds the request line, the Host
+    field and the content length, writing into a buffer the caller
+    keeps, so that sending from a template allocates nothing once that
+    buffer has grown to the size of the header.
+*/
+class QCURL_AUTOTEST_EXPORT QCurlRequestTemplatePrivate : public QSharedData
+{
+public:
+    void serializeFields();
+    void serialize(const QString &path, const QByteArray &host,
+                   const QList<QPair<QByteArray, QByteArray> > &values, const QByteArray &body,
+                   QByteArray &out) const;
+
+    QCurlRequestHeader prototype;   // the method and the fixed fields
+    QByteArray methodPart;          // "GET "
+    QByteArray fields;              // the fixed fields as they are sent
+};
+
+QT_END_NAMESPACE
+
+#endif // QCURLREQUEST_P_H
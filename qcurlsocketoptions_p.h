@@ -0,0 +1,191 @@
+/****************************************************************************
+**
+** Copyright (C) 2012 Digia Plc and/or its subsidiary(-ies).
+** Contact: http://www.qt-project.org/legal
+**
+** This file is part of the QtNetwork module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QCURLSOCKETOPTIONS_P_H
+#define QCURLSOCKETOPTIONS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists purely as an
+// implementation detail.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+
+#include "qcurl.h"
+
+#include <qvariant.h>
+
+#ifdef Q_OS_UNIX
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#endif
+
+QT_BEGIN_NAMESPACE
+
+static const int QCurlSocketOptionCount = QCurl::KeepAliveCountOption + 1;
+
+// the dynamic property through which transports that create their socket
+// themselves get the options before they connect
+#define QCURL_SOCKET_OPTIONS_PROPERTY "_q_curlSocketOptions"
+
+#if defined(Q_OS_LINUX) && !defined(TCP_FASTOPEN_CONNECT)
+# define TCP_FASTOPEN_CONNECT 30
+#endif
+
+// reads the options QCurl published on \a socket, -1 where none is set
+static inline void qt_curl_socketOptions(const QObject *socket, int *options)
+{
+    QVariantList list = socket->property(QCURL_SOCKET_OPTIONS_PROPERTY).toList();
+    for (int i = 0; i < QCurlSocketOptionCount; ++i)
+        options[i] = i < list.count() ? list.at(i).toInt() : -1;
+}
+
+#ifdef Q_OS_UNIX
+static inline void qt_curl_setSocketOption(int fd, int level, int name, int value)
+{
+    ::setsockopt(fd, level, name, &value, sizeof(value));
+}
+#endif
+
+/*
+    Sets \a options, indexed by QCurl::SocketOption, on the socket \a fd;
+    -1 leaves the system default. Fast Open only has an effect while the
+    socket is not connected yet (\a connecting). Options the socket does
+    not support, like the TCP ones on a local socket, are ignored.
+*/
+static inline void qt_curl_applySocketOptions(int fd, const int *options, bool connecting)
+{
+#ifdef Q_OS_UNIX
+    if (fd == -1)
+        return;
+    if (options[QCurl::LowDelayOption] >= 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, options[QCurl::LowDelayOption] != 0);
+    if (options[QCurl::SendBufferSizeOption] > 0)
+        qt_curl_setSocketOption(fd, SOL_SOCKET, SO_SNDBUF, options[QCurl::SendBufferSizeOption]);
+    if (options[QCurl::ReceiveBufferSizeOption] > 0)
+        qt_curl_setSocketOption(fd, SOL_SOCKET, SO_RCVBUF, options[QCurl::ReceiveBufferSizeOption]);
+    if (options[QCurl::KeepAliveOption] >= 0)
+        qt_curl_setSocketOption(fd, SOL_SOCKET, SO_KEEPALIVE, options[QCurl::KeepAliveOption] != 0);
+#if defined(TCP_KEEPIDLE)
+    if (options[QCurl::KeepAliveIdleOption] > 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options[QCurl::KeepAliveIdleOption]);
+#elif defined(TCP_KEEPALIVE)
+    if (options[QCurl::KeepAliveIdleOption] > 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_KEEPALIVE, options[QCurl::KeepAliveIdleOption]);
+#endif
+#ifdef TCP_KEEPINTVL
+    if (options[QCurl::KeepAliveIntervalOption] > 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, options[QCurl::KeepAliveIntervalOption]);
+#endif
+#ifdef TCP_KEEPCNT
+    if (options[QCurl::KeepAliveCountOption] > 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_KEEPCNT, options[QCurl::KeepAliveCountOption]);
+#endif
+#ifdef TCP_QUICKACK
+    if (options[QCurl::QuickAckOption] >= 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, options[QCurl::QuickAckOption] != 0);
+#endif
+#ifdef TCP_FASTOPEN_CONNECT
+    if (connecting && options[QCurl::FastOpenOption] > 0)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#endif
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(options);
+    Q_UNUSED(connecting);
+#endif
+}
+
+/*
+    Restores the system default of \a option on the socket \a fd, after
+    it was set to a value of its own, as far as the system allows: the
+    flags are cleared again, but the kernel keeps a buffer size or a
+    keep-alive timing once it was set, until the next connection.
+*/
+static inline void qt_curl_resetSocketOption(int fd, int option)
+{
+#ifdef Q_OS_UNIX
+    if (fd == -1)
+        return;
+    switch (option) {
+    case QCurl::LowDelayOption:
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 0);
+        break;
+    case QCurl::KeepAliveOption:
+        qt_curl_setSocketOption(fd, SOL_SOCKET, SO_KEEPALIVE, 0);
+        break;
+#ifdef TCP_QUICKACK
+    case QCurl::QuickAckOption:
+        // back to the kernel switching between both modes on its own
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+        break;
+#endif
+    default:
+        break;
+    }
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(option);
+#endif
+}
+
+// the kernel leaves quick acknowledgement mode on its own, so it is set
+// again after every read
+static inline void qt_curl_renewQuickAck(int fd)
+{
+#ifdef TCP_QUICKACK
+    if (fd != -1)
+        qt_curl_setSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+#else
+    Q_UNUSED(fd);
+#endif
+}
+
+QT_END_NAMESPACE
+
+#endif // QCURLSOCKETOPTIONS_P_H
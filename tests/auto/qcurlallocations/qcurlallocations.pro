@@ -0,0 +1,13 @@
+# Counts the allocations of the request path. Build QCurl with
+# qmake CONFIG+=developer-build first, in the directory above tests/.
+
+CONFIG += testcase c++11
+CONFIG -= app_bundle
+TARGET = tst_qcurlallocations
+QT = core network testlib
+
+DEFINES += QCURL_BUILD_INTERNAL
+INCLUDEPATH += $$PWD/../../..
+LIBS += -L$$OUT_PWD/../../.. -lQCurl
+
+SOURCES += tst_qcurlallocations.cpp
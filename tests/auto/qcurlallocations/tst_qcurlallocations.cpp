@@ -0,0 +1,168 @@
+#include <QtTest/QtTest>
+
+#include "qcurlrequest_p.h"
+
+#include <new>
+#include <stdlib.h>
+
+/*
+    Every operator new of the process is counted, and with glibc every
+    malloc(), calloc() and realloc() as well: that is where QByteArray,
+    QString and QList get their data from.
+*/
+static bool counting = false;
+static int allocations = 0;
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+extern "C" void *malloc(size_t size) __THROW
+{
+    if (counting)
+        ++allocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) __THROW
+{
+    if (counting)
+        ++allocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) __THROW
+{
+    if (counting)
+        ++allocations;
+    return __libc_realloc(p, size);
+}
+
+static inline void *rawAllocate(size_t size)
+{
+    return __libc_malloc(size);
+}
+#else
+static inline void *rawAllocate(size_t size)
+{
+    return ::malloc(size);
+}
+#endif
+
+void *operator new(size_t size)
+{
+    if (counting)
+        ++allocations;
+    if (void *p = rawAllocate(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) Q_DECL_NOTHROW
+{
+    ::free(p);
+}
+
+void operator delete[](void *p) Q_DECL_NOTHROW
+{
+    ::free(p);
+}
+
+void operator delete(void *p, size_t) Q_DECL_NOTHROW
+{
+    ::free(p);
+}
+
+void operator delete[](void *p, size_t) Q_DECL_NOTHROW
+{
+    ::free(p);
+}
+
+static void startCounting()
+{
+    allocations = 0;
+    counting = true;
+}
+
+static int stopCounting()
+{
+    counting = false;
+    return allocations;
+}
+
+class tst_QCurlAllocations : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void recordPool();
+    void templateSerialization();
+};
+
+// the sizes of request records and header privates, taken and given
+// back as a stream of requests does
+void tst_QCurlAllocations::recordPool()
+{
+    static const size_t sizes[] = { 24, 96, 200, 480 };
+    enum { Count = sizeof(sizes) / sizeof(sizes[0]) };
+    void *records[Count];
+
+    // the first round creates the pool of the thread and fills its lists
+    for (int i = 0; i < Count; ++i)
+        records[i] = QCurlRecordPool::allocate(sizes[i]);
+    for (int i = 0; i < Count; ++i)
+        QCurlRecordPool::release(records[i], sizes[i]);
+
+    startCounting();
+    for (int round = 0; round < 1000; ++round) {
+        for (int i = 0; i < Count; ++i)
+            records[i] = QCurlRecordPool::allocate(sizes[i]);
+        for (int i = 0; i < Count; ++i)
+            QCurlRecordPool::release(records[i], sizes[i]);
+    }
+    QCOMPARE(stopCounting(), 0);
+}
+
+// the header of a template request, written into the buffer QCurl keeps
+void tst_QCurlAllocations::templateSerialization()
+{
+    QCurlRequestTemplatePrivate tmpl;
+    tmpl.prototype.setRequest(QLatin1String("POST"), QString());
+    tmpl.prototype.setValue(QLatin1String("Connection"), QLatin1String("Keep-Alive"));
+    tmpl.prototype.setValue(QLatin1String("Accept"), QLatin1String("application/json"));
+    tmpl.serializeFields();
+
+    const QString path = QLatin1String("/items?page=2");
+    const QByteArray host("example.org:8080");
+    QList<QPair<QByteArray, QByteArray> > values;
+    values.append(qMakePair(QByteArray("X-Request-Id"), QByteArray("42")));
+    const QByteArray body("{}");
+    const QByteArray expected("POST /items?page=2 HTTP/1.1\r\n"
+                              "Host: example.org:8080\r\n"
+                              "Connection: Keep-Alive\r\n"
+                              "Accept: application/json\r\n"
+                              "X-Request-Id: 42\r\n"
+                              "content-length: 2\r\n"
+                              "\r\n");
+
+    // the first request grows the buffer
+    QByteArray out;
+    tmpl.serialize(path, host, values, body, out);
+    QCOMPARE(out, expected);
+
+    startCounting();
+    for (int i = 0; i < 1000; ++i)
+        tmpl.serialize(path, host, values, body, out);
+    QCOMPARE(stopCounting(), 0);
+    QCOMPARE(out, expected);
+}
+
+QTEST_APPLESS_MAIN(tst_QCurlAllocations)
+
+#include "tst_qcurlallocations.moc"